@@ -0,0 +1,220 @@
+/**
+ *
+ * cpulimit - a CPU limiter for Linux
+ *
+ * Copyright (C) 2005-2012, by:  Angelo Marletta <angelo dot marletta at gmail dot com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "affinity.h"
+#include "util.h"
+
+#if defined(__linux__)
+
+#include <dirent.h>
+#include <sched.h>
+
+/* Passes over the threads of a process, which may create threads meanwhile */
+#define MAX_TASK_ROUNDS 4
+
+struct saved_affinity
+{
+    pid_t pid;
+    cpu_set_t mask;
+};
+
+int init_process_affinity(struct process_affinity *a, int ncpu)
+{
+    cpu_set_t *mask, *default_mask;
+    int cpu, n = 0;
+    a->saved = NULL;
+    a->count = a->capacity = 0;
+    mask = (cpu_set_t *)malloc(sizeof(cpu_set_t));
+    default_mask = (cpu_set_t *)malloc(sizeof(cpu_set_t));
+    if (mask == NULL || default_mask == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed for the CPU masks\n");
+        exit(EXIT_FAILURE);
+    }
+    a->mask = mask;
+    a->default_mask = default_mask;
+    a->ncpu = ncpu;
+    if (sched_getaffinity(0, sizeof(cpu_set_t), default_mask) != 0 ||
+        CPU_COUNT(default_mask) <= ncpu)
+    {
+        close_process_affinity(a);
+        return -1;
+    }
+    /* the first allowed CPUs, siblings are usually numbered apart */
+    CPU_ZERO(mask);
+    for (cpu = 0; cpu < CPU_SETSIZE && n < ncpu; cpu++)
+    {
+        if (CPU_ISSET((size_t)cpu, default_mask))
+        {
+            CPU_SET((size_t)cpu, mask);
+            n++;
+        }
+    }
+    return 0;
+}
+
+/* set the affinity of all the threads of a process, return -1 if none could be set */
+static int set_process_affinity(pid_t pid, const cpu_set_t *mask)
+{
+    char path[64];
+    int round, set = 0, tasks = -1, count;
+    sprintf(path, "/proc/%ld/task", (long)pid);
+    /* threads created while the threads are listed are listed again */
+    for (round = 0; round < MAX_TASK_ROUNDS; round++)
+    {
+        struct dirent *d;
+        DIR *dir = opendir(path);
+        syscall_count += 2;
+        if (dir == NULL)
+            return -1;
+        count = 0;
+        while ((d = readdir(dir)) != NULL)
+        {
+            pid_t tid = (pid_t)atol(d->d_name);
+            if (tid <= 0)
+                continue;
+            count++;
+            syscall_count++;
+            if (sched_setaffinity(tid, sizeof(cpu_set_t), mask) == 0)
+                set++;
+        }
+        closedir(dir);
+        if (count == tasks)
+            break;
+        tasks = count;
+    }
+    return set > 0 ? 0 : -1;
+}
+
+/* return the index of the first saved affinity whose PID is not lower than pid */
+static int find_saved(const struct process_affinity *a, pid_t pid)
+{
+    int lo = 0, hi = a->count;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (a->saved[mid].pid < pid)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+int confine_process(struct process_affinity *a, pid_t pid)
+{
+    cpu_set_t original;
+    int i;
+    syscall_count++;
+    if (sched_getaffinity(pid, sizeof(cpu_set_t), &original) != 0)
+        return errno == ESRCH ? 0 : -1;
+    /* the children of confined processes are born confined */
+    if (CPU_EQUAL(&original, (cpu_set_t *)a->mask))
+        memcpy(&original, a->default_mask, sizeof(cpu_set_t));
+    if (set_process_affinity(pid, (cpu_set_t *)a->mask) != 0)
+        return errno == ESRCH || errno == ENOENT ? 0 : -1;
+    i = find_saved(a, pid);
+    if (i == a->count || a->saved[i].pid != pid)
+    {
+        if (a->count == a->capacity)
+        {
+            a->capacity = MAX(a->capacity * 2, 16);
+            a->saved = (struct saved_affinity *)realloc(a->saved, (size_t)a->capacity * sizeof(struct saved_affinity));
+            if (a->saved == NULL)
+            {
+                fprintf(stderr, "Memory allocation failed for the saved affinities\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        memmove(&a->saved[i + 1], &a->saved[i], (size_t)(a->count - i) * sizeof(struct saved_affinity));
+        a->count++;
+        a->saved[i].pid = pid;
+        a->saved[i].mask = original;
+    }
+    return 0;
+}
+
+void release_process(struct process_affinity *a, pid_t pid)
+{
+    int i = find_saved(a, pid);
+    if (i == a->count || a->saved[i].pid != pid)
+        return;
+    /* fails harmlessly if the process has exited */
+    set_process_affinity(pid, &a->saved[i].mask);
+    memmove(&a->saved[i], &a->saved[i + 1], (size_t)(a->count - i - 1) * sizeof(struct saved_affinity));
+    a->count--;
+}
+
+void close_process_affinity(struct process_affinity *a)
+{
+    int i;
+    for (i = 0; i < a->count; i++)
+        set_process_affinity(a->saved[i].pid, &a->saved[i].mask);
+    free(a->saved);
+    free(a->mask);
+    free(a->default_mask);
+    a->saved = NULL;
+    a->mask = a->default_mask = NULL;
+    a->count = a->capacity = 0;
+}
+
+#else
+
+int init_process_affinity(struct process_affinity *a, int ncpu)
+{
+    a->ncpu = ncpu;
+    a->mask = a->default_mask = NULL;
+    a->saved = NULL;
+    a->count = a->capacity = 0;
+    errno = ENOSYS;
+    return -1;
+}
+
+int confine_process(struct process_affinity *a, pid_t pid)
+{
+    (void)a;
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+}
+
+void release_process(struct process_affinity *a, pid_t pid)
+{
+    (void)a;
+    (void)pid;
+}
+
+void close_process_affinity(struct process_affinity *a)
+{
+    (void)a;
+}
+
+#endif
@@ -0,0 +1,94 @@
+/**
+ *
+ * cpulimit - a CPU limiter for Linux
+ *
+ * Copyright (C) 2005-2012, by:  Angelo Marletta <angelo dot marletta at gmail dot com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef __AFFINITY_H
+#define __AFFINITY_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <sys/types.h>
+
+/* Original affinity of a confined process, defined by the implementation */
+struct saved_affinity;
+
+/**
+ * Structure representing the confinement of processes, with all their
+ * threads, to a subset of the CPUs, so that the stop phases only have to
+ * take away the fraction of a CPU left above the limit.
+ */
+struct process_affinity
+{
+    /* Number of CPUs the processes are confined to */
+    int ncpu;
+
+    /* CPU mask of the confinement, defined by the implementation */
+    void *mask;
+
+    /* Affinity of the limiter, given back to the processes born confined */
+    void *default_mask;
+
+    /* Original affinities of the confined processes, sorted by PID */
+    struct saved_affinity *saved;
+    int count;
+    int capacity;
+};
+
+/**
+ * Chooses the CPUs to which the processes are confined among those on
+ * which the limiter may run.
+ *
+ * @param a The confinement to initialize.
+ * @param ncpu Number of CPUs given to the processes.
+ * @return 0 on success, -1 if affinities are not supported or if fewer
+ *         than ncpu + 1 CPUs are available (confining would be useless).
+ */
+int init_process_affinity(struct process_affinity *a, int ncpu);
+
+/**
+ * Confines all the threads of a process, remembering its affinity.
+ *
+ * @param a The confinement.
+ * @param pid The PID of the process.
+ * @return 0 on success or if the process has exited, -1 if the
+ *         affinity of the process cannot be changed.
+ */
+int confine_process(struct process_affinity *a, pid_t pid);
+
+/**
+ * Gives back its affinity to a process which left the limited group.
+ *
+ * @param a The confinement.
+ * @param pid The PID of the process, which may have exited.
+ */
+void release_process(struct process_affinity *a, pid_t pid);
+
+/**
+ * Gives back their affinity to all the confined processes and frees the
+ * confinement.
+ *
+ * @param a The confinement.
+ */
+void close_process_affinity(struct process_affinity *a);
+
+#endif
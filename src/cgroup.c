@@ -0,0 +1,661 @@
+/**
+ *
+ * cpulimit - a CPU limiter for Linux
+ *
+ * Copyright (C) 2005-2012, by:  Angelo Marletta <angelo dot marletta at gmail dot com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cgroup.h"
+#include "util.h"
+
+#if defined(__linux__)
+
+#include <limits.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <time.h>
+
+#ifndef CGROUP2_SUPER_MAGIC
+#define CGROUP2_SUPER_MAGIC 0x63677270
+#endif
+
+int open_cgroup(const char *path)
+{
+    struct statfs sfs;
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    if (fstatfs(fd, &sfs) != 0 || sfs.f_type != CGROUP2_SUPER_MAGIC)
+    {
+        close(fd);
+        errno = ENOTDIR;
+        return -1;
+    }
+    return fd;
+}
+
+int cgroup_is_populated(int cgroup_fd)
+{
+    char buf[256];
+    const char *line;
+    ssize_t n;
+    int fd = openat(cgroup_fd, "cgroup.events", O_RDONLY | O_CLOEXEC);
+    syscall_count += 3;
+    if (fd < 0)
+        return -1;
+    n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n < 0)
+        return -1;
+    buf[n] = '\0';
+    /* "populated 0|1" is one of the "key value" lines */
+    for (line = buf; line != NULL; line = strchr(line, '\n'))
+    {
+        if (*line == '\n')
+            line++;
+        if (strncmp(line, "populated ", 10) == 0)
+            return line[10] == '1';
+    }
+    return -1;
+}
+
+int wait_cgroup_populated(int cgroup_fd, int timeout_ms)
+{
+    char path[64];
+    struct pollfd pfd;
+    struct timespec start, now;
+    int ret;
+    pfd.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (pfd.fd < 0)
+        return -1;
+    /* the watch follows the directory even if it is renamed */
+    sprintf(path, "/proc/self/fd/%d/cgroup.events", cgroup_fd);
+    if (inotify_add_watch(pfd.fd, path, IN_MODIFY) < 0 || get_time(&start) != 0)
+    {
+        close(pfd.fd);
+        return -1;
+    }
+    /* the state is checked once watched, so that no change is missed */
+    while ((ret = cgroup_is_populated(cgroup_fd)) == 0)
+    {
+        char events[4096];
+        int remaining = -1;
+        if (timeout_ms >= 0)
+        {
+            if (get_time(&now) != 0)
+            {
+                ret = -1;
+                break;
+            }
+            remaining = timeout_ms - (int)timediff_in_ms(&now, &start);
+            if (remaining <= 0)
+                break;
+        }
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        syscall_count++;
+        if (poll(&pfd, 1, remaining) < 0 && errno != EINTR)
+        {
+            ret = -1;
+            break;
+        }
+        /* drain the queue, the content of the events does not matter */
+        while (read(pfd.fd, events, sizeof(events)) > 0)
+            ;
+    }
+    close(pfd.fd);
+    return ret;
+}
+
+/* Name of the cgroup2 file system in /proc/self/mounts */
+#define CGROUP2_FSTYPE "cgroup2"
+
+/* Attempts to empty the leaf of a freezer, whose processes may still fork */
+#define CLOSE_ROUNDS 10
+
+/* find where the cgroup2 hierarchy is mounted */
+static int find_cgroup2_root(char *path, size_t size)
+{
+    char line[PATH_MAX + 128], mount[PATH_MAX], type[16];
+    FILE *f = fopen("/proc/self/mounts", "r");
+    int found = 0;
+    if (f == NULL)
+        return -1;
+    while (!found && fgets(line, sizeof(line), f) != NULL)
+        found = sscanf(line, "%*s %4095s %15s", mount, type) == 2 &&
+                strcmp(type, CGROUP2_FSTYPE) == 0 && strlen(mount) < size;
+    fclose(f);
+    if (!found)
+        return -1;
+    strcpy(path, mount);
+    return 0;
+}
+
+/* read the cgroup of a process, relative to the root of the hierarchy and without leading '/'.
+   errno is ENOENT or ESRCH if the process has exited, ENODATA if it is in no cgroup of the
+   hierarchy and ENAMETOOLONG if the path does not fit */
+static int read_process_cgroup(pid_t pid, char *path, size_t size)
+{
+    char name[64], line[PATH_MAX + 8];
+    FILE *f;
+    int found = 0, err = ENODATA;
+    sprintf(name, "/proc/%ld/cgroup", (long)pid);
+    syscall_count += 3;
+    if ((f = fopen(name, "r")) == NULL)
+        return -1;
+    /* the line of the unified hierarchy is "0::/path" */
+    while (!found && fgets(line, sizeof(line), f) != NULL)
+    {
+        found = strncmp(line, "0::/", 4) == 0;
+        if (found && strlen(line + 4) >= size)
+        {
+            found = 0;
+            err = ENAMETOOLONG;
+            break;
+        }
+    }
+    if (!found && ferror(f))
+        err = errno;
+    fclose(f);
+    if (!found)
+    {
+        errno = err;
+        return -1;
+    }
+    strcpy(path, line + 4);
+    path[strcspn(path, "\n")] = '\0';
+    return 0;
+}
+
+/* write a PID to the cgroup.procs file of a cgroup, given relative to dirfd ("" for dirfd itself) */
+static int write_pid(int dirfd, const char *cgroup, pid_t pid)
+{
+    char path[PATH_MAX + 16], buf[32];
+    int fd, len, ret;
+    sprintf(path, "%s%scgroup.procs", cgroup, *cgroup != '\0' ? "/" : "");
+    fd = openat(dirfd, path, O_WRONLY | O_CLOEXEC);
+    syscall_count += 3;
+    if (fd < 0)
+        return -1;
+    len = sprintf(buf, "%ld\n", (long)pid);
+    ret = write(fd, buf, (size_t)len) == len ? 0 : -1;
+    close(fd);
+    return ret;
+}
+
+static void append_pid(pid_t **pids, int *count, int *capacity, pid_t pid)
+{
+    if (*count == *capacity)
+    {
+        *capacity = MAX(*capacity * 2, 64);
+        if ((*pids = (pid_t *)realloc(*pids, (size_t)*capacity * sizeof(pid_t))) == NULL)
+        {
+            fprintf(stderr, "Memory allocation failed for the PIDs of the cgroup\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    (*pids)[(*count)++] = pid;
+}
+
+/* read the PIDs listed by the cgroup.procs file of a cgroup, return their number */
+static int read_pids(int cgroup_fd, pid_t **pids)
+{
+    char buf[4096];
+    ssize_t n, pos;
+    pid_t pid = 0;
+    int count = 0, capacity = 0;
+    int fd = openat(cgroup_fd, "cgroup.procs", O_RDONLY | O_CLOEXEC);
+    *pids = NULL;
+    if (fd < 0)
+        return -1;
+    /* one PID per line, a PID may span two reads */
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+    {
+        for (pos = 0; pos < n; pos++)
+        {
+            if (buf[pos] >= '0' && buf[pos] <= '9')
+                pid = pid * 10 + (buf[pos] - '0');
+            else if (pid > 0)
+            {
+                append_pid(pids, &count, &capacity, pid);
+                pid = 0;
+            }
+        }
+    }
+    close(fd);
+    if (pid > 0)
+        append_pid(pids, &count, &capacity, pid);
+    return n < 0 ? -1 : count;
+}
+
+int cgroup_has_process(int cgroup_fd, pid_t pid)
+{
+    char root[PATH_MAX], path[PATH_MAX];
+    struct stat target, root_st, st;
+    int fd, root_fd, ret = -1;
+    if (fstat(cgroup_fd, &target) != 0 || find_cgroup2_root(root, sizeof(root)) != 0 ||
+        read_process_cgroup(pid, path, sizeof(path)) != 0)
+        return -1;
+    if ((root_fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+        return -1;
+    fd = openat(root_fd, *path != '\0' ? path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    /* walk up from the cgroup of the process to the root */
+    while (fd >= 0 && fstat(root_fd, &root_st) == 0 && fstat(fd, &st) == 0)
+    {
+        int parent;
+        if (st.st_dev == target.st_dev && st.st_ino == target.st_ino)
+        {
+            ret = 1;
+            break;
+        }
+        if (st.st_dev == root_st.st_dev && st.st_ino == root_st.st_ino)
+        {
+            ret = 0;
+            break;
+        }
+        parent = openat(fd, "..", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        close(fd);
+        fd = parent;
+    }
+    if (fd >= 0)
+        close(fd);
+    close(root_fd);
+    return ret;
+}
+
+static void init_freezer(struct cgroup_freezer *f)
+{
+    f->cgroup_fd = f->freeze_fd = f->root_fd = -1;
+    f->leaf[0] = '\0';
+    f->origins = NULL;
+    f->origin_count = 0;
+    f->moved = NULL;
+    f->moved_count = f->moved_capacity = 0;
+}
+
+int open_cgroup_freezer(struct cgroup_freezer *f, int cgroup_fd)
+{
+    init_freezer(f);
+    f->cgroup_fd = cgroup_fd;
+    /* cgroup.freeze exists since Linux 5.2, except in the root cgroup */
+    f->freeze_fd = openat(cgroup_fd, "cgroup.freeze", O_WRONLY | O_CLOEXEC);
+    return f->freeze_fd < 0 ? -1 : 0;
+}
+
+int create_cgroup_freezer(struct cgroup_freezer *f)
+{
+    char root[PATH_MAX];
+    init_freezer(f);
+    if (find_cgroup2_root(root, sizeof(root)) != 0 || (f->root_fd = open_cgroup(root)) < 0)
+        return -1;
+    sprintf(f->leaf, "cpulimit.%ld", (long)getpid());
+    if (mkdirat(f->root_fd, f->leaf, 0755) != 0 && errno != EEXIST)
+    {
+        close(f->root_fd);
+        f->root_fd = -1;
+        return -1;
+    }
+    f->cgroup_fd = openat(f->root_fd, f->leaf, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (f->cgroup_fd < 0 ||
+        (f->freeze_fd = openat(f->cgroup_fd, "cgroup.freeze", O_WRONLY | O_CLOEXEC)) < 0)
+    {
+        close_cgroup_freezer(f);
+        return -1;
+    }
+    return 0;
+}
+
+/* return the index of the first move whose PID is not lower than pid */
+static int find_move(const struct cgroup_freezer *f, pid_t pid)
+{
+    int lo = 0, hi = f->moved_count;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (f->moved[mid].pid < pid)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* return the index of a cgroup in the origins, adding it if needed */
+static int find_origin(struct cgroup_freezer *f, const char *path)
+{
+    int i;
+    for (i = 0; i < f->origin_count; i++)
+    {
+        if (strcmp(f->origins[i], path) == 0)
+            return i;
+    }
+    f->origins = (char **)realloc(f->origins, (size_t)(f->origin_count + 1) * sizeof(char *));
+    if (f->origins == NULL || (f->origins[i] = (char *)malloc(strlen(path) + 1)) == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed for the cgroups of the processes\n");
+        exit(EXIT_FAILURE);
+    }
+    strcpy(f->origins[i], path);
+    f->origin_count++;
+    return i;
+}
+
+int cgroup_freezer_add(struct cgroup_freezer *f, pid_t pid)
+{
+    char path[PATH_MAX];
+    int i, origin;
+    if (f->root_fd < 0)
+        return 0;
+    /* a process which has exited is not an error */
+    if (read_process_cgroup(pid, path, sizeof(path)) != 0)
+        return errno == ENOENT || errno == ESRCH ? 0 : -1;
+    /* the children of the moved processes are born in the leaf */
+    if (strcmp(path, f->leaf) == 0)
+        return 0;
+    origin = find_origin(f, path);
+    if (write_pid(f->cgroup_fd, "", pid) != 0)
+        return errno == ESRCH ? 0 : -1;
+    i = find_move(f, pid);
+    if (i == f->moved_count || f->moved[i].pid != pid)
+    {
+        if (f->moved_count == f->moved_capacity)
+        {
+            f->moved_capacity = MAX(f->moved_capacity * 2, 64);
+            f->moved = (struct cgroup_move *)realloc(f->moved, (size_t)f->moved_capacity * sizeof(struct cgroup_move));
+            if (f->moved == NULL)
+            {
+                fprintf(stderr, "Memory allocation failed for the moved processes\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        memmove(&f->moved[i + 1], &f->moved[i], (size_t)(f->moved_count - i) * sizeof(struct cgroup_move));
+        f->moved_count++;
+        f->moved[i].pid = pid;
+    }
+    f->moved[i].origin = origin;
+    return 0;
+}
+
+void cgroup_freezer_remove(struct cgroup_freezer *f, pid_t pid)
+{
+    int i = find_move(f, pid);
+    if (i == f->moved_count || f->moved[i].pid != pid)
+        return;
+    /* fails harmlessly if the process has exited */
+    write_pid(f->root_fd, f->origins[f->moved[i].origin], pid);
+    memmove(&f->moved[i], &f->moved[i + 1], (size_t)(f->moved_count - i - 1) * sizeof(struct cgroup_move));
+    f->moved_count--;
+}
+
+int cgroup_freezer_set(struct cgroup_freezer *f, int frozen)
+{
+    syscall_count++;
+    return pwrite(f->freeze_fd, frozen ? "1" : "0", 1, 0) == 1 ? 0 : -1;
+}
+
+void close_cgroup_freezer(struct cgroup_freezer *f)
+{
+    int i, round;
+    if (f->freeze_fd >= 0)
+    {
+        cgroup_freezer_set(f, 0);
+        close(f->freeze_fd);
+    }
+    /* move the processes back, those born in the leaf go to the first origin */
+    for (round = 0; f->root_fd >= 0 && f->cgroup_fd >= 0 && round < CLOSE_ROUNDS; round++)
+    {
+        pid_t *pids;
+        int count = read_pids(f->cgroup_fd, &pids);
+        for (i = 0; i < count; i++)
+        {
+            int j = find_move(f, pids[i]);
+            const char *origin = "";
+            if (j < f->moved_count && f->moved[j].pid == pids[i])
+                origin = f->origins[f->moved[j].origin];
+            else if (f->origin_count > 0)
+                origin = f->origins[0];
+            write_pid(f->root_fd, origin, pids[i]);
+        }
+        free(pids);
+        if (count <= 0)
+            break;
+    }
+    if (f->cgroup_fd >= 0 && f->root_fd >= 0)
+        close(f->cgroup_fd);
+    if (f->root_fd >= 0)
+    {
+        unlinkat(f->root_fd, f->leaf, AT_REMOVEDIR);
+        close(f->root_fd);
+    }
+    for (i = 0; i < f->origin_count; i++)
+        free(f->origins[i]);
+    free(f->origins);
+    free(f->moved);
+    init_freezer(f);
+}
+
+/* read a file of a cgroup into a NUL-terminated buffer */
+static int read_cgroup_file(int cgroup_fd, const char *name, char *buf, size_t size)
+{
+    ssize_t n;
+    int fd = openat(cgroup_fd, name, O_RDONLY | O_CLOEXEC);
+    syscall_count += 3;
+    if (fd < 0)
+        return -1;
+    n = read(fd, buf, size - 1);
+    close(fd);
+    if (n < 0)
+        return -1;
+    buf[n] = '\0';
+    return 0;
+}
+
+/* write a string to a file of a cgroup */
+static int write_cgroup_file(int cgroup_fd, const char *name, const char *value)
+{
+    size_t len = strlen(value);
+    int ret, fd = openat(cgroup_fd, name, O_WRONLY | O_CLOEXEC);
+    syscall_count += 3;
+    if (fd < 0)
+        return -1;
+    ret = write(fd, value, len) == (ssize_t)len ? 0 : -1;
+    close(fd);
+    return ret;
+}
+
+int enable_cgroup_cpu(int cgroup_fd)
+{
+    int parent, ret;
+    if (faccessat(cgroup_fd, "cpu.max", W_OK, 0) == 0)
+        return 0;
+    if ((parent = openat(cgroup_fd, "..", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+        return -1;
+    /* the root cgroup is exempt from the rule forbidding to enable
+       controllers for the children of a cgroup with processes */
+    ret = write_cgroup_file(parent, "cgroup.subtree_control", "+cpu");
+    close(parent);
+    return ret == 0 && faccessat(cgroup_fd, "cpu.max", W_OK, 0) == 0 ? 0 : -1;
+}
+
+int read_cgroup_cpu_max(int cgroup_fd, char *buf, size_t size)
+{
+    if (read_cgroup_file(cgroup_fd, "cpu.max", buf, size) != 0)
+        return -1;
+    buf[strcspn(buf, "\n")] = '\0';
+    return 0;
+}
+
+int write_cgroup_cpu_max(int cgroup_fd, const char *value)
+{
+    return write_cgroup_file(cgroup_fd, "cpu.max", value);
+}
+
+int read_cgroup_cpu_stat(int cgroup_fd, struct cgroup_cpu_stat *st)
+{
+    char buf[1024];
+    const char *p;
+    memset(st, 0, sizeof(*st));
+    if (read_cgroup_file(cgroup_fd, "cpu.stat", buf, sizeof(buf)) != 0)
+        return -1;
+    /* one "key value" pair per line */
+    for (p = buf; *p != '\0'; p++)
+    {
+        const char *key = p;
+        int64_t *field = NULL, value = 0;
+        size_t len;
+        p += strcspn(p, " \n");
+        len = (size_t)(p - key);
+        if (len == 10 && strncmp(key, "usage_usec", len) == 0)
+            field = &st->usage_usec;
+        else if (len == 10 && strncmp(key, "nr_periods", len) == 0)
+            field = &st->nr_periods;
+        else if (len == 12 && strncmp(key, "nr_throttled", len) == 0)
+            field = &st->nr_throttled;
+        else if (len == 14 && strncmp(key, "throttled_usec", len) == 0)
+            field = &st->throttled_usec;
+        for (p += *p == ' '; *p >= '0' && *p <= '9'; p++)
+            value = value * 10 + (*p - '0');
+        if (field != NULL)
+            *field = value;
+        p += strcspn(p, "\n");
+        if (*p == '\0')
+            break;
+    }
+    return 0;
+}
+
+#else
+
+int open_cgroup(const char *path)
+{
+    (void)path;
+    errno = ENOSYS;
+    return -1;
+}
+
+int cgroup_is_populated(int cgroup_fd)
+{
+    (void)cgroup_fd;
+    errno = ENOSYS;
+    return -1;
+}
+
+int wait_cgroup_populated(int cgroup_fd, int timeout_ms)
+{
+    (void)cgroup_fd;
+    (void)timeout_ms;
+    errno = ENOSYS;
+    return -1;
+}
+
+int cgroup_has_process(int cgroup_fd, pid_t pid)
+{
+    (void)cgroup_fd;
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+}
+
+int open_cgroup_freezer(struct cgroup_freezer *f, int cgroup_fd)
+{
+    (void)f;
+    (void)cgroup_fd;
+    errno = ENOSYS;
+    return -1;
+}
+
+int create_cgroup_freezer(struct cgroup_freezer *f)
+{
+    (void)f;
+    errno = ENOSYS;
+    return -1;
+}
+
+int cgroup_freezer_add(struct cgroup_freezer *f, pid_t pid)
+{
+    (void)f;
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+}
+
+void cgroup_freezer_remove(struct cgroup_freezer *f, pid_t pid)
+{
+    (void)f;
+    (void)pid;
+}
+
+int cgroup_freezer_set(struct cgroup_freezer *f, int frozen)
+{
+    (void)f;
+    (void)frozen;
+    errno = ENOSYS;
+    return -1;
+}
+
+void close_cgroup_freezer(struct cgroup_freezer *f)
+{
+    (void)f;
+}
+
+
+int enable_cgroup_cpu(int cgroup_fd)
+{
+    (void)cgroup_fd;
+    errno = ENOSYS;
+    return -1;
+}
+
+int read_cgroup_cpu_max(int cgroup_fd, char *buf, size_t size)
+{
+    (void)cgroup_fd;
+    (void)buf;
+    (void)size;
+    errno = ENOSYS;
+    return -1;
+}
+
+int write_cgroup_cpu_max(int cgroup_fd, const char *value)
+{
+    (void)cgroup_fd;
+    (void)value;
+    errno = ENOSYS;
+    return -1;
+}
+
+int read_cgroup_cpu_stat(int cgroup_fd, struct cgroup_cpu_stat *st)
+{
+    (void)cgroup_fd;
+    (void)st;
+    errno = ENOSYS;
+    return -1;
+}
+#endif
@@ -0,0 +1,225 @@
+/**
+ *
+ * cpulimit - a CPU limiter for Linux
+ *
+ * Copyright (C) 2005-2012, by:  Angelo Marletta <angelo dot marletta at gmail dot com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef __CGROUP_H
+#define __CGROUP_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * Process moved into the cgroup of a freezer, with the cgroup it came from.
+ */
+struct cgroup_move
+{
+    /* PID of the process */
+    pid_t pid;
+
+    /* Index of the cgroup the process came from in the origins of the freezer */
+    int origin;
+};
+
+/**
+ * CPU statistics of a cgroup, read from its cpu.stat file.
+ */
+struct cgroup_cpu_stat
+{
+    /* CPU time used by the processes of the cgroup (in microseconds) */
+    int64_t usage_usec;
+
+    /* Number of enforcement periods elapsed while the processes were runnable */
+    int64_t nr_periods;
+
+    /* Number of periods in which the processes were throttled */
+    int64_t nr_throttled;
+
+    /* Total time during which the processes were throttled (in microseconds) */
+    int64_t throttled_usec;
+};
+
+/**
+ * Structure representing a cgroup whose processes are frozen and thawed
+ * together by writing its cgroup.freeze file. The cgroup is either given
+ * by the user or a leaf created for the limited processes, which are moved
+ * into it and moved back to their cgroups when the freezer is closed.
+ */
+struct cgroup_freezer
+{
+    /* Descriptor of the frozen cgroup */
+    int cgroup_fd;
+
+    /* Descriptor of its cgroup.freeze file */
+    int freeze_fd;
+
+    /* Descriptor of the root of the cgroup2 hierarchy, -1 if the cgroup is not owned */
+    int root_fd;
+
+    /* Name of the leaf created in the root of the hierarchy */
+    char leaf[32];
+
+    /* Cgroups the moved processes came from, relative to the root */
+    char **origins;
+    int origin_count;
+
+    /* Processes moved into the leaf, sorted by PID */
+    struct cgroup_move *moved;
+    int moved_count;
+    int moved_capacity;
+};
+
+/**
+ * Opens the directory of a cgroup of the unified (v2) hierarchy.
+ *
+ * @param path Path of the cgroup directory, e.g. /sys/fs/cgroup/mygroup.
+ * @return A descriptor of the directory, or -1 if the path cannot be opened
+ *         or is not in a cgroup2 file system (errno is then ENOTDIR).
+ */
+int open_cgroup(const char *path);
+
+/**
+ * Tells whether a cgroup or one of its descendants has live processes,
+ * according to its cgroup.events file.
+ *
+ * @param cgroup_fd Descriptor returned by open_cgroup().
+ * @return 1 if the cgroup is populated, 0 if it is empty, -1 on error.
+ */
+int cgroup_is_populated(int cgroup_fd);
+
+/**
+ * Waits until a cgroup is populated, sleeping until the kernel reports a
+ * modification of its cgroup.events file instead of polling it.
+ *
+ * @param cgroup_fd Descriptor returned by open_cgroup().
+ * @param timeout_ms Timeout in milliseconds, or -1 to wait indefinitely.
+ * @return 1 if the cgroup is populated, 0 on timeout, -1 on error.
+ */
+int wait_cgroup_populated(int cgroup_fd, int timeout_ms);
+
+/**
+ * Tells whether a process belongs to a cgroup or to one of its descendants.
+ *
+ * @param cgroup_fd Descriptor returned by open_cgroup().
+ * @param pid The PID of the process.
+ * @return 1 if the process is in the subtree of the cgroup, 0 if it is not,
+ *         -1 on error.
+ */
+int cgroup_has_process(int cgroup_fd, pid_t pid);
+
+/**
+ * Prepares the freezing of an existing cgroup, whose processes are not moved.
+ *
+ * @param f The freezer to initialize.
+ * @param cgroup_fd Descriptor returned by open_cgroup(), which must stay
+ *                  open while the freezer uses it.
+ * @return 0 on success, -1 if the cgroup cannot be frozen.
+ */
+int open_cgroup_freezer(struct cgroup_freezer *f, int cgroup_fd);
+
+/**
+ * Creates a leaf cgroup, in the root of the cgroup2 hierarchy, into which
+ * the processes to freeze are moved.
+ *
+ * @param f The freezer to initialize.
+ * @return 0 on success, -1 if the hierarchy is not available or not writable.
+ */
+int create_cgroup_freezer(struct cgroup_freezer *f);
+
+/**
+ * Moves a process into the leaf of the freezer, remembering its cgroup.
+ * Does nothing if the freezer does not own its cgroup, or if the process
+ * is already in it.
+ *
+ * @param f The freezer.
+ * @param pid The PID of the process.
+ * @return 0 on success or if the process has exited, -1 if the process
+ *         cannot be moved.
+ */
+int cgroup_freezer_add(struct cgroup_freezer *f, pid_t pid);
+
+/**
+ * Moves a process which left the limited group back to its cgroup.
+ *
+ * @param f The freezer.
+ * @param pid The PID of the process, which may have exited.
+ */
+void cgroup_freezer_remove(struct cgroup_freezer *f, pid_t pid);
+
+/**
+ * Freezes or thaws all the processes of the cgroup with a single write.
+ *
+ * @param f The freezer.
+ * @param frozen 1 to freeze the processes, 0 to thaw them.
+ * @return 0 on success, -1 on error.
+ */
+int cgroup_freezer_set(struct cgroup_freezer *f, int frozen);
+
+/**
+ * Thaws the cgroup and, if the freezer created it, moves its processes
+ * back to their cgroups and removes it.
+ *
+ * @param f The freezer.
+ */
+void close_cgroup_freezer(struct cgroup_freezer *f);
+
+/**
+ * Lets the cgroup use the cpu controller, enabling it in the
+ * cgroup.subtree_control file of its parent if needed.
+ *
+ * @param cgroup_fd Descriptor returned by open_cgroup().
+ * @return 0 on success, -1 if the controller is not available.
+ */
+int enable_cgroup_cpu(int cgroup_fd);
+
+/**
+ * Reads the cpu.max file of a cgroup, to restore it later.
+ *
+ * @param cgroup_fd Descriptor returned by open_cgroup().
+ * @param buf Buffer receiving the content, e.g. "max 100000".
+ * @param size Size of the buffer.
+ * @return 0 on success, -1 on error.
+ */
+int read_cgroup_cpu_max(int cgroup_fd, char *buf, size_t size);
+
+/**
+ * Writes the cpu.max file of a cgroup, so that the kernel throttles its
+ * processes once they have used quota_usec of CPU time in a period.
+ *
+ * @param cgroup_fd Descriptor returned by open_cgroup().
+ * @param value The content, "QUOTA PERIOD" in microseconds or "max PERIOD".
+ * @return 0 on success, -1 on error.
+ */
+int write_cgroup_cpu_max(int cgroup_fd, const char *value);
+
+/**
+ * Reads the CPU statistics of a cgroup.
+ *
+ * @param cgroup_fd Descriptor returned by open_cgroup().
+ * @param st The statistics, the fields not reported by the kernel are 0.
+ * @return 0 on success, -1 on error.
+ */
+int read_cgroup_cpu_stat(int cgroup_fd, struct cgroup_cpu_stat *st);
+
+#endif
@@ -0,0 +1,60 @@
+/**
+ *
+ * cpulimit - a CPU limiter for Linux
+ *
+ * Copyright (C) 2005-2012, by:  Angelo Marletta <angelo dot marletta at gmail dot com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "controller.h"
+#include "util.h"
+
+void pi_controller_init(struct pi_controller *c, double kp, double ki, double kd,
+                        double tau, double min, double max)
+{
+    c->kp = kp;
+    c->ki = ki;
+    c->kd = kd;
+    c->tau = tau;
+    c->min = min;
+    c->max = max;
+    pi_controller_reset(c, min);
+}
+
+void pi_controller_reset(struct pi_controller *c, double output)
+{
+    c->integral = MAX(MIN(output, c->max), c->min);
+    c->derivative = 0;
+    c->previous_error = 0;
+    c->primed = 0;
+}
+
+double pi_controller_update(struct pi_controller *c, double error, double dt)
+{
+    double integral = c->integral + c->ki * error * dt;
+    double output;
+    /* derivative of the error through the filter kd s / (tau s + 1), discretized backward */
+    if (c->kd > 0 && c->primed && dt > 0)
+        c->derivative = (c->tau * c->derivative + c->kd * (error - c->previous_error)) / (c->tau + dt);
+    c->previous_error = error;
+    c->primed = 1;
+    output = c->kp * error + integral + c->derivative;
+    /* anti-windup: no integration that would push a saturated output further */
+    if (!((output > c->max && error > 0) || (output < c->min && error < 0)))
+        c->integral = MAX(MIN(integral, c->max), c->min);
+    output = c->kp * error + c->integral + c->derivative;
+    return MAX(MIN(output, c->max), c->min);
+}
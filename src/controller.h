@@ -0,0 +1,93 @@
+/**
+ *
+ * cpulimit - a CPU limiter for Linux
+ *
+ * Copyright (C) 2005-2012, by:  Angelo Marletta <angelo dot marletta at gmail dot com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef __CONTROLLER_H
+#define __CONTROLLER_H
+
+/**
+ * Structure representing a PI controller, with an optional derivative
+ * term filtered by a first order low-pass filter. The integral term stops
+ * growing while the output is saturated (anti-windup), so the controller
+ * reacts at once when the error changes sign.
+ */
+struct pi_controller
+{
+    /* Proportional gain */
+    double kp;
+
+    /* Integral gain (per second) */
+    double ki;
+
+    /* Derivative gain (in seconds), 0 disables the derivative term */
+    double kd;
+
+    /* Time constant of the filter of the derivative term (in seconds) */
+    double tau;
+
+    /* Bounds of the output */
+    double min;
+    double max;
+
+    /* Integral term, which is the output once the error is 0 */
+    double integral;
+
+    /* Filtered derivative term */
+    double derivative;
+
+    /* Error of the previous update, and whether there was one */
+    double previous_error;
+    int primed;
+};
+
+/**
+ * Initializes a controller, whose output starts at min.
+ *
+ * @param c The controller to initialize.
+ * @param kp Proportional gain.
+ * @param ki Integral gain (per second).
+ * @param kd Derivative gain (in seconds), 0 to disable the derivative term.
+ * @param tau Time constant of the filter of the derivative term (in seconds).
+ * @param min Lower bound of the output.
+ * @param max Upper bound of the output.
+ */
+void pi_controller_init(struct pi_controller *c, double kp, double ki, double kd,
+                        double tau, double min, double max);
+
+/**
+ * Restarts the controller from a given output, without a bump.
+ *
+ * @param c The controller.
+ * @param output The current output, clamped to the bounds.
+ */
+void pi_controller_reset(struct pi_controller *c, double output);
+
+/**
+ * Computes the next output from the error.
+ *
+ * @param c The controller.
+ * @param error The error, setpoint minus measurement.
+ * @param dt Time elapsed since the previous update (in seconds).
+ * @return The output, between the bounds.
+ */
+double pi_controller_update(struct pi_controller *c, double error, double dt);
+
+#endif
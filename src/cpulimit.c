@@ -42,6 +42,12 @@
 #include <unistd.h>
 #include <limits.h>
 
+#include "affinity.h"
+#include "cgroup.h"
+#include "controller.h"
+#include "estimator.h"
+#include "event_loop.h"
+#include "process_events.h"
 #include "process_group.h"
 #include "list.h"
 #include "util.h"
@@ -55,6 +61,33 @@
 /* Each slot is split into a working slice and a sleeping slice */
 #define TIME_SLOT 100000
 
+/* Maximum number of rounds looking for new processes after a stop phase */
+#define MAX_STOP_ROUNDS 8
+
+/* The processes are stopped and resumed with SIGSTOP and SIGCONT */
+#define BACKEND_SIGNAL 0
+
+/* The processes are frozen and thawed together through a cgroup v2 */
+#define BACKEND_FREEZER 1
+
+/* The kernel throttles the processes through the cpu.max file of a cgroup v2 */
+#define BACKEND_CPUMAX 2
+
+/* The working rate is adjusted by a PI controller */
+#define CONTROLLER_PI 0
+
+/* The working rate is multiplied by the ratio of the limit to the CPU usage */
+#define CONTROLLER_RATIO 1
+
+/* Interval between two checks of the processes throttled by the kernel (in seconds) */
+#define SUPERVISE_INTERVAL 1
+
+/* Smallest quota accepted in cpu.max (in microseconds) */
+#define CPU_MAX_MIN_QUOTA 1000
+
+/* Maximum number of threads in the breakdown of the verbose output */
+#define MAX_THREADS_SHOWN 64
+
 /* GLOBAL VARIABLES */
 
 /* Define a global process group (family of processes) */
@@ -69,6 +102,12 @@ const char *program_name;
 /* Number of CPUs available in the system */
 int NCPU;
 
+/* Descriptor delivering process events, or -1 if they are not used */
+int events_fd = -1;
+
+/* Descriptor of the cgroup whose processes are limited, or -1 */
+int cgroup_fd = -1;
+
 /* CONFIGURATION VARIABLES */
 
 /* Verbose mode flag */
@@ -77,6 +116,28 @@ int verbose = 0;
 /* Lazy mode flag (exit if no process is found) */
 int lazy = 0;
 
+/* Events mode flag (track processes through kernel events) */
+int use_events = 0;
+
+/* Fork-tight mode flag (stop the processes forked during a stop phase) */
+int fork_tight = 0;
+
+/* How the processes are stopped and resumed (one of the BACKEND_* values) */
+int backend = BACKEND_SIGNAL;
+
+/* Affinity mode flag (confine the processes to as many CPUs as the limit needs) */
+int use_affinity = 0;
+
+/* How the working rate is adjusted (one of the CONTROLLER_* values) */
+int controller_mode = CONTROLLER_PI;
+
+/* Gains of the PI controller, negative for the defaults */
+double gain_kp = -1, gain_ki = -1, gain_kd = 0;
+
+/* How the CPU usage is estimated (one of the ESTIMATOR_* values) and its time constant (in ms) */
+int estimator_type = ESTIMATOR_EWMA;
+double estimator_tau = ESTIMATOR_DEFAULT_TAU;
+
 /* Quit flag for handling SIGINT and SIGTERM signals */
 volatile sig_atomic_t quit_flag = 0;
 
@@ -112,13 +173,49 @@ static void print_usage_and_exit(FILE *stream, int exit_code)
     fprintf(stream, "Usage: %s [OPTIONS...] TARGET\n", program_name);
     fprintf(stream, "   OPTIONS\n");
     fprintf(stream, "      -l, --limit=N          percentage of cpu allowed from 0 to %d (required)\n", 100 * NCPU);
-    fprintf(stream, "      -v, --verbose          show control statistics\n");
+    fprintf(stream, "      -v, --verbose          show control statistics, twice to add the\n");
+    fprintf(stream, "                             usage of the threads of the busiest process\n");
     fprintf(stream, "      -z, --lazy             exit if there is no target process, or if it dies\n");
+    fprintf(stream, "      -a, --all              with -e, limit together all the matching processes,\n");
+    fprintf(stream, "                             which join and leave as they start and exit\n");
     fprintf(stream, "      -i, --include-children limit also the children processes\n");
+    fprintf(stream, "      -f, --fork-tight       after stopping the processes, stop also the children\n");
+    fprintf(stream, "                             they forked meanwhile (useful with -i)\n");
+    fprintf(stream, "      -E, --events           track processes through kernel events instead of\n");
+    fprintf(stream, "                             scanning /proc (Linux, requires CAP_NET_ADMIN)\n");
+    fprintf(stream, "      -b, --backend=MODE     how the processes are stopped: signal (SIGSTOP and\n");
+    fprintf(stream, "                             SIGCONT, the default), freezer (cgroup v2\n");
+    fprintf(stream, "                             freezer) or cpumax (cgroup v2 cpu.max quota\n");
+    fprintf(stream, "                             enforced by the kernel). The cgroup backends\n");
+    fprintf(stream, "                             are for Linux and fall back to signal if the\n");
+    fprintf(stream, "                             cgroup hierarchy is not writable\n");
+    fprintf(stream, "      -A, --affinity         confine the processes to as few CPUs as the limit\n");
+    fprintf(stream, "                             allows, so that only the fraction of a CPU left\n");
+    fprintf(stream, "                             is taken away by stopping them (Linux)\n");
+    fprintf(stream, "      -C, --controller=MODE  how the share of time the processes run is\n");
+    fprintf(stream, "                             adjusted: pi (the default) or ratio (multiplied\n");
+    fprintf(stream, "                             by the ratio of the limit to the CPU usage)\n");
+    fprintf(stream, "      -G, --gains=KP,KI[,KD] gains of the pi controller, KI per second and KD\n");
+    fprintf(stream, "                             in seconds (default KP 1, KI 1/tau, KD 0: as\n");
+    fprintf(stream, "                             fast as the estimation of the CPU usage)\n");
+    fprintf(stream, "      -u, --estimator=MODE   how the CPU usage is estimated: ewma (moving\n");
+    fprintf(stream, "                             average, the default), window (exact average\n");
+    fprintf(stream, "                             over the time constant) or kalman (reacting\n");
+    fprintf(stream, "                             faster to the changes of the load)\n");
+    fprintf(stream, "      -T, --tau=SECONDS      time constant of the estimation (default 1.2)\n");
+    fprintf(stream, "      -t, --threads=N        read /proc with up to N threads (Linux, default 1,\n");
+    fprintf(stream, "                             useful with very large process tables)\n");
     fprintf(stream, "      -h, --help             display this help and exit\n");
     fprintf(stream, "   TARGET must be exactly one of these:\n");
     fprintf(stream, "      -p, --pid=N            pid of the process (implies -z)\n");
     fprintf(stream, "      -e, --exe=FILE         name of the executable program file or path name\n");
+    fprintf(stream, "      -m, --match=MODE       how -e selects processes: name (base name of the\n");
+    fprintf(stream, "                             command, the default), exe (same executable file,\n");
+    fprintf(stream, "                             looked up in PATH), glob or regex (pattern on the\n");
+    fprintf(stream, "                             base name of the command, or on the whole command\n");
+    fprintf(stream, "                             if the pattern contains a '/')\n");
+    fprintf(stream, "      -g, --cgroup=PATH      all the processes of a cgroup v2 and of its\n");
+    fprintf(stream, "                             descendants, limited together (Linux)\n");
     fprintf(stream, "      COMMAND [ARGS]         run this command and limit it (implies -z)\n");
     fprintf(stream, "\nReport bugs to <marlonx80@hotmail.com>.\n");
     exit(exit_code);
@@ -154,24 +251,410 @@ static double get_dynamic_time_slot(void)
     return time_slot;
 }
 
+/**
+ * Stops the processes which joined the group while it was being stopped,
+ * until the membership of the group does not change anymore or the
+ * maximum number of rounds is reached.
+ *
+ * @return Number of processes which escaped the stop phase.
+ */
+static int stop_new_processes(void)
+{
+    struct list joined;
+    struct list_node *node;
+    int round, escaped = 0;
+    init_list(&joined, sizeof(pid_t));
+    for (round = 0; round < MAX_STOP_ROUNDS; round++)
+    {
+        if (refresh_process_group(&pgroup, &joined) == 0)
+            break;
+        for (node = joined.first; node != NULL; node = node->next)
+        {
+            const struct process *proc = (const struct process *)(node->data);
+            /* a dead process is removed from the group at the next update */
+            syscall_count++;
+            signal_process(proc, SIGSTOP);
+        }
+        escaped += joined.count;
+        clear_list(&joined);
+    }
+    return escaped;
+}
+
+/**
+ * Prints the CPU usage of each thread of a process since the previous call,
+ * if it was about the same process.
+ *
+ * @param pid The PID of the process.
+ */
+static void print_thread_usage(pid_t pid)
+{
+    static struct thread_cputime last[MAX_THREADS_SHOWN];
+    static int last_count = 0;
+    static pid_t last_pid = 0;
+    static struct timespec last_time;
+    struct thread_cputime now[MAX_THREADS_SHOWN];
+    struct timespec now_time;
+    double dt;
+    int i, j, count = read_thread_cputimes(pid, now, MAX_THREADS_SHOWN);
+    if (count < 0)
+        return;
+    if (get_time(&now_time))
+    {
+        exit(EXIT_FAILURE);
+    }
+    dt = timediff_in_ms(&now_time, &last_time);
+    if (pid == last_pid && dt > 0)
+    {
+        printf("  threads of %ld:", (long)pid);
+        for (i = 0; i < count; i++)
+        {
+            for (j = 0; j < last_count && last[j].tid != now[i].tid; j++)
+                ;
+            if (j < last_count)
+                printf(" %ld %.1f%%", (long)now[i].tid, (now[i].cputime - last[j].cputime) / dt * 100);
+        }
+        printf("\n");
+    }
+    memcpy(last, now, (size_t)count * sizeof(struct thread_cputime));
+    last_count = count;
+    last_pid = pid;
+    last_time = now_time;
+}
+
+/**
+ * Waits before searching for the target process again. When process
+ * events are available, the wait ends as soon as a process executes
+ * the target program.
+ *
+ * @param matcher Pattern of the target process, or NULL to just sleep.
+ * @param wait_time Maximum time to wait.
+ */
+static void wait_for_target(struct process_matcher *matcher, const struct timespec *wait_time)
+{
+    struct process_event events[64];
+    struct timespec start, now;
+    double timeout, elapsed;
+
+    if (events_fd < 0 || matcher == NULL || get_time(&start) != 0)
+    {
+        sleep_timespec(wait_time);
+        return;
+    }
+    timeout = (double)wait_time->tv_sec * 1000.0 + (double)wait_time->tv_nsec / 1000000.0;
+    while (!quit_flag)
+    {
+        int i, n;
+        if (get_time(&now) != 0)
+            return;
+        elapsed = timediff_in_ms(&now, &start);
+        if (elapsed >= timeout ||
+            wait_process_events(events_fd, (int)(timeout - elapsed) + 1) <= 0)
+            return;
+        /* if events have been lost, search again right away */
+        if ((n = read_process_events(events_fd, events, 64)) < 0)
+        {
+            process_matcher_forget_all(matcher);
+            return;
+        }
+        for (i = 0; i < n; i++)
+        {
+            if (events[i].type == PROCESS_EVENT_EXEC &&
+                process_matches(events[i].pid, matcher))
+                return;
+        }
+    }
+}
+
+/**
+ * Prepares the freezing of the process group: the cgroup given by the user
+ * is frozen as a whole, otherwise the members are moved into a new cgroup.
+ *
+ * @param freezer The freezer to initialize.
+ * @param whole_cgroup Whether the group is made of the processes of cgroup_fd.
+ * @return 1 if the freezer is used, 0 if the processes must be signalled.
+ */
+static int setup_freezer(struct cgroup_freezer *freezer, int whole_cgroup)
+{
+    const struct list_node *node;
+    if (whole_cgroup)
+    {
+        /* the limiter must not freeze itself */
+        if (cgroup_has_process(cgroup_fd, cpulimit_pid) == 0 &&
+            open_cgroup_freezer(freezer, cgroup_fd) == 0)
+            return 1;
+    }
+    else if (create_cgroup_freezer(freezer) == 0)
+    {
+        for (node = pgroup.proclist->first; node != NULL; node = node->next)
+        {
+            if (cgroup_freezer_add(freezer, ((const struct process *)node->data)->pid) != 0)
+                break;
+        }
+        if (node == NULL)
+            return 1;
+        close_cgroup_freezer(freezer);
+    }
+    fprintf(stderr, "Warning: the cgroup v2 hierarchy cannot be used, using signals instead\n");
+    return 0;
+}
+
+/**
+ * Moves the processes which joined the group since the last update into
+ * the cgroup of the freezer, and those which left out of it. The children
+ * of the members need no move, they are born in the cgroup.
+ *
+ * @param freezer The freezer of the group.
+ * @return 0 on success, -1 if a process cannot be moved.
+ */
+static int sync_freezer(struct cgroup_freezer *freezer)
+{
+    int i;
+    for (i = 0; i < pgroup.left.count; i++)
+        cgroup_freezer_remove(freezer, pgroup.left.pid[i]);
+    for (i = 0; i < pgroup.joined.count; i++)
+    {
+        if (cgroup_freezer_add(freezer, pgroup.joined.pid[i]) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * Stops using the cgroup of the freezer, whose processes are thawed and moved back.
+ *
+ * @param freezer The freezer of the group.
+ * @return 0, the new value of the flag telling whether the freezer is used.
+ */
+static int fall_back_to_signals(struct cgroup_freezer *freezer)
+{
+    close_cgroup_freezer(freezer);
+    fprintf(stderr, "Warning: throttling through the cgroup failed, using signals instead\n");
+    return 0;
+}
+
+/**
+ * Confines the members of the process group to the CPUs the limit needs,
+ * e.g. 4 CPUs for a limit of 350%.
+ *
+ * @param affinity The confinement to initialize.
+ * @param limit The CPU usage limit (1 means one CPU).
+ * @return 1 if the processes are confined, 0 otherwise.
+ */
+static int setup_affinity(struct process_affinity *affinity, double limit)
+{
+    const struct list_node *node;
+    int ncpu = MAX((int)limit, 1);
+    if ((double)ncpu < limit)
+        ncpu++;
+    if (init_process_affinity(affinity, ncpu) != 0)
+    {
+        fprintf(stderr, "Warning: the processes cannot be confined to %d CPUs\n", ncpu);
+        return 0;
+    }
+    for (node = pgroup.proclist->first; node != NULL; node = node->next)
+    {
+        if (confine_process(affinity, ((const struct process *)node->data)->pid) != 0)
+        {
+            close_process_affinity(affinity);
+            fprintf(stderr, "Warning: the affinity of the processes cannot be changed\n");
+            return 0;
+        }
+    }
+    if (verbose)
+        printf("Processes confined to %d CPUs\n", ncpu);
+    return 1;
+}
+
+/**
+ * Confines the processes which joined the group since the last update
+ * and gives back their affinity to those which left. A process which
+ * cannot be confined is only limited by the stop phases.
+ *
+ * @param affinity The confinement of the group.
+ */
+static void sync_affinity(struct process_affinity *affinity)
+{
+    int i;
+    for (i = 0; i < pgroup.left.count; i++)
+        release_process(affinity, pgroup.left.pid[i]);
+    for (i = 0; i < pgroup.joined.count; i++)
+        confine_process(affinity, pgroup.joined.pid[i]);
+}
+
+/**
+ * Waits for the next deadline of the control loop, noting a termination
+ * signal received meanwhile.
+ *
+ * @param loop The event loop.
+ * @param duration Time between the previous deadline and the next one.
+ */
+static void wait_deadline(struct event_loop *loop, const struct timespec *duration)
+{
+    int ret = event_loop_wait(loop, duration);
+    if (ret == EVENT_LOOP_QUIT)
+        quit_flag = 1;
+    else if (ret < 0)
+        sleep_timespec(duration);
+}
+
+/**
+ * Lets the kernel throttle the processes of the group through the cpu.max
+ * file of the cgroup of the freezer. The limiter then only follows the
+ * membership of the group and reports the throttling, until the group is
+ * empty (as for limit_process()) or the limiter is asked to quit.
+ *
+ * @param freezer The freezer of the group, whose cgroup holds the members.
+ * @param pid Process ID of the target process, or 0 (see limit_process()).
+ * @param matcher Pattern of the processes, or NULL (see limit_process()).
+ * @param limit The CPU usage limit (1 means one CPU).
+ * @param affinity The confinement of the group, or NULL.
+ * @param loop The event loop timing the checks.
+ * @return 0 when done, -1 if cpu.max cannot be used or a member cannot be
+ *         moved into the cgroup. cpu.max is restored in both cases.
+ */
+static int supervise_cpu_max(struct cgroup_freezer *freezer, pid_t pid,
+                             struct process_matcher *matcher, double limit,
+                             struct process_affinity *affinity, struct event_loop *loop)
+{
+    const struct timespec interval = {SUPERVISE_INTERVAL, 0};
+    const struct timespec wait_time = {2, 0};
+    struct cgroup_cpu_stat last, now;
+    struct timespec last_time, now_time;
+    char saved[64], value[64];
+    unsigned long last_syscall_count = syscall_count;
+    int c = 0, ret = 0;
+    long quota = MAX((long)(limit * TIME_SLOT), (long)CPU_MAX_MIN_QUOTA);
+
+    if (enable_cgroup_cpu(freezer->cgroup_fd) != 0 ||
+        read_cgroup_cpu_max(freezer->cgroup_fd, saved, sizeof(saved)) != 0)
+        return -1;
+    sprintf(value, "%ld %d", quota, TIME_SLOT);
+    if (write_cgroup_cpu_max(freezer->cgroup_fd, value) != 0)
+        return -1;
+    if (verbose)
+        printf("Throttling through cpu.max \"%s\"\n", value);
+    /* from now on, every path goes through the restoration of cpu.max */
+    if (read_cgroup_cpu_stat(freezer->cgroup_fd, &last) != 0 || get_time(&last_time))
+        ret = -1;
+
+    event_loop_restart(loop);
+    while (!quit_flag && ret == 0)
+    {
+        wait_deadline(loop, &interval);
+        if (quit_flag)
+            break;
+        update_process_group(&pgroup);
+        if (pgroup.proclist->count == 0)
+        {
+            if (verbose)
+                printf("No more processes.\n");
+            if (pid != 0 || lazy)
+                break;
+            event_loop_suspend(loop);
+            if (matcher == NULL)
+                wait_cgroup_populated(cgroup_fd, 1000 * (int)wait_time.tv_sec);
+            else
+                wait_for_target(matcher, &wait_time);
+            event_loop_resume(loop);
+            pgroup.resync = 1;
+            continue;
+        }
+        /* a member left outside of the cgroup would escape the quota */
+        if (sync_freezer(freezer) != 0)
+        {
+            ret = -1;
+            break;
+        }
+        if (affinity != NULL)
+            sync_affinity(affinity);
+        if (!verbose || read_cgroup_cpu_stat(freezer->cgroup_fd, &now) != 0)
+            continue;
+        if (get_time(&now_time))
+        {
+            ret = -1;
+            break;
+        }
+        if (c % 20 == 0)
+            printf("\n%9s%12s%16s%16s%8s\n", "%CPU", "throttled", "throttled time",
+                   "syscalls/check", "members");
+        /* usage and throttled time in microseconds, elapsed time in milliseconds */
+        printf("%8.2f%%%11.2f%%%13.0f ms%16lu%8d\n",
+               (double)(now.usage_usec - last.usage_usec) / 10 /
+                   MAX(timediff_in_ms(&now_time, &last_time), EPSILON),
+               now.nr_periods > last.nr_periods
+                   ? (double)(now.nr_throttled - last.nr_throttled) * 100 /
+                         (double)(now.nr_periods - last.nr_periods)
+                   : 0.0,
+               (double)(now.throttled_usec - last.throttled_usec) / 1000,
+               syscall_count - last_syscall_count, pgroup.proclist->count);
+        last = now;
+        last_time = now_time;
+        last_syscall_count = syscall_count;
+        c = (c + 1) % 20;
+    }
+    write_cgroup_cpu_max(freezer->cgroup_fd, saved);
+    return ret;
+}
+
 /**
  * Controls the CPU usage of a process (and optionally its children).
  * Limits the amount of time the process can run based on a given percentage.
  *
- * @param pid Process ID of the target process.
+ * @param pid Process ID of the target process, or 0 to use the matcher.
+ * @param matcher Pattern of all the processes limited together if pid is 0,
+ *                or NULL to limit the processes of the cgroup of cgroup_fd.
+ *                The limiter then waits for new members when none is left,
+ *                unless it is lazy.
  * @param limit The CPU usage limit as a percentage (0.0 to 1.0).
  * @param include_children Whether to include child processes.
  */
-static void limit_process(pid_t pid, double limit, int include_children)
+static void limit_process(pid_t pid, struct process_matcher *matcher, double limit,
+                          int include_children)
 {
+    /* Waiting time between searches for new instances */
+    const struct timespec wait_time = {2, 0};
     /* Slice of time in which the process is allowed to work */
     struct timespec twork;
     /* Slice of time in which the process is stopped */
     struct timespec tsleep;
     /* Generic list item for iterating over processes */
     struct list_node *node;
+    /* Index in the vectors of the process group */
+    int i;
     /* Counter to help with printing status */
     int c = 0;
+    /* System call counter at the last status line */
+    unsigned long last_syscall_count = syscall_count;
+    /* Number of processes which escaped a stop phase since the last status line */
+    int escaped = 0;
+    /* Number of processes which joined and left the group since the last status line */
+    int joined = 0, left = 0;
+    /* Freezer of the group, and whether it is used instead of signals */
+    struct cgroup_freezer freezer;
+    int use_freezer = 0;
+    /* Time spent resuming and stopping the group since the last status line (in ms) */
+    double resume_time = 0, stop_time = 0;
+    /* Number of resume and stop phases since the last status line */
+    int resumes = 0, stops = 0;
+    /* Start and end of a resume or stop phase */
+    struct timespec phase_start, phase_end;
+    /* Whether the kernel has throttled the group through cpu.max */
+    int supervised = 0;
+    /* Confinement of the group to a subset of the CPUs, and whether it is used */
+    struct process_affinity affinity;
+    int confined = 0;
+    /* Estimation of the CPU usage, and its lag (in seconds): a window lags
+       by half its span */
+    struct usage_estimator estimator;
+    const double tau = estimator_tau / 1000 / (estimator_type == ESTIMATOR_WINDOW ? 2 : 1);
+    /* Controller of the working rate */
+    struct pi_controller controller;
+    /* Loop waiting for the absolute deadlines of the phases */
+    struct event_loop loop;
+    /* Delay of the wake ups after the deadlines since the last status line (in ns) */
+    double wakeup_delay = 0;
+    int wakeups = 0;
 
     /* The ratio of the time the process is allowed to work (range 0 to 1) */
     double workingrate = -1;
@@ -179,15 +662,62 @@ static void limit_process(pid_t pid, double limit, int include_children)
     /* Increase priority of the current process to reduce overhead */
     increase_priority();
 
+    /* Allow a descriptor per member of large groups, besides the scans */
+    raise_fd_limit();
+
     /* Initialize the process group (including children if needed) */
-    init_process_group(&pgroup, pid, include_children);
+    if (pid == 0 && matcher == NULL)
+        init_process_group_cgroup(&pgroup, cgroup_fd);
+    else if (pid == 0)
+        init_process_group_matching(&pgroup, matcher, include_children);
+    else
+        init_process_group(&pgroup, pid, include_children);
+
+    /* Track the membership of the group through process events if available */
+    if (events_fd >= 0)
+        process_group_use_events(&pgroup, events_fd);
+
+    usage_estimator_init(&estimator, estimator_type, estimator_tau);
+    process_group_use_estimator(&pgroup, &estimator);
+
+    /* The default gains make the loop settle as fast as the estimation of the
+       CPU usage (IMC tuning, the scaled plant being a first order lag) */
+    pi_controller_init(&controller, gain_kp >= 0 ? gain_kp : 1.0, gain_ki >= 0 ? gain_ki : 1.0 / tau,
+                       gain_kd, tau / 4, EPSILON, 1 - EPSILON);
+
+    /* Wait for the deadlines and the termination signals together */
+    if (open_event_loop(&loop) != 0 && verbose)
+        printf("Event loop not available, sleeping between the deadlines\n");
+
+    /* Leave the processes as many CPUs as the limit needs */
+    if (use_affinity)
+        confined = setup_affinity(&affinity, limit);
+
+    /* Freeze the whole group at once, or let the kernel throttle it, if possible */
+    if (backend != BACKEND_SIGNAL)
+        use_freezer = setup_freezer(&freezer, pid == 0 && matcher == NULL);
+    if (use_freezer && backend == BACKEND_CPUMAX)
+    {
+        supervised = supervise_cpu_max(&freezer, pid, matcher, limit,
+                                       confined ? &affinity : NULL, &loop) == 0;
+        if (!supervised)
+            use_freezer = fall_back_to_signals(&freezer);
+    }
 
-    if (verbose)
+    if (verbose && pid == 0 && matcher == NULL)
+        printf("Members in the process group of the cgroup: %d\n", pgroup.proclist->count);
+    else if (verbose && pid == 0)
+        printf("Members in the process group of %s: %d\n",
+               matcher->pattern, pgroup.proclist->count);
+    else if (verbose)
         printf("Members in the process group owned by %ld: %d\n",
                (long)pgroup.target_pid, pgroup.proclist->count);
 
-    /* Main loop to control the process until quit_flag is set */
-    while (!quit_flag)
+    /* Main loop to control the process until quit_flag is set, each phase
+       ending at a deadline counted from the previous one so that the
+       overhead of the cycle does not make it drift */
+    event_loop_restart(&loop);
+    while (!quit_flag && !supervised)
     {
         /* CPU usage of the controlled processes */
         /* 1 means that the processes are using 100% cpu */
@@ -195,6 +725,10 @@ static void limit_process(pid_t pid, double limit, int include_children)
         double twork_total_nsec, tsleep_total_nsec;
         double time_slot;
 
+        /* Count the membership changes since the previous update */
+        joined += pgroup.joined.count;
+        left += pgroup.left.count;
+
         /* Update the process group, including checking for dead processes */
         update_process_group(&pgroup);
 
@@ -203,42 +737,62 @@ static void limit_process(pid_t pid, double limit, int include_children)
         {
             if (verbose)
                 printf("No more processes.\n");
-            break;
+            if (pid != 0 || lazy)
+                break;
+            /* wait for a new member, and scan again to find it, the
+               signals interrupting the wait as before the loop */
+            event_loop_suspend(&loop);
+            if (matcher == NULL)
+                wait_cgroup_populated(cgroup_fd, 1000 * (int)wait_time.tv_sec);
+            else
+                wait_for_target(matcher, &wait_time);
+            event_loop_resume(&loop);
+            pgroup.resync = 1;
+            continue;
         }
 
         /* Estimate CPU usage of all processes in the group */
-        for (node = pgroup.proclist->first; node != NULL; node = node->next)
+        for (i = 0; i < pgroup.hot.count; i++)
         {
-            const struct process *proc = (const struct process *)(node->data);
-            if (proc->cpu_usage < 0)
+            if (pgroup.hot.cpu_usage[i] < 0)
             {
                 continue;
             }
             if (pcpu < 0)
                 pcpu = 0;
-            pcpu += proc->cpu_usage;
+            pcpu += pgroup.hot.cpu_usage[i];
         }
 
+        /* Get the dynamic time slot */
+        time_slot = get_dynamic_time_slot();
+
         /* Adjust the work and sleep time slices based on CPU usage */
         if (pcpu < 0)
         {
-            /* Initialize workingrate if it's the first cycle */
+            /* Initialize workingrate if it's the first cycle, the confined
+               processes only need to be stopped for the fraction of a CPU */
             pcpu = limit;
-            workingrate = limit;
+            workingrate = confined ? limit / affinity.ncpu : limit;
+            pi_controller_reset(&controller, workingrate);
         }
-        else
+        else if (controller_mode == CONTROLLER_RATIO)
         {
             /* Adjust workingrate based on CPU usage and limit */
             workingrate = workingrate * limit / MAX(pcpu, EPSILON);
         }
+        else
+        {
+            /* the error is scaled by the CPU usage of the group if it was never
+               stopped, so that the gains do not depend on the number of threads */
+            double demand = pcpu / MAX(workingrate, EPSILON);
+            workingrate = pi_controller_update(&controller, (limit - pcpu) / MAX(demand, EPSILON),
+                                               time_slot / 1e6);
+        }
 
         /* Clamp workingrate to the valid range (0, 1) */
         workingrate = MIN(workingrate, 1 - EPSILON);
         workingrate = MAX(workingrate, EPSILON);
 
-        /* Get the dynamic time slot */
-        time_slot = get_dynamic_time_slot();
-
         /* Calculate work and sleep times in nanoseconds */
         twork_total_nsec = time_slot * 1000 * workingrate;
         nsec2timespec(twork_total_nsec, &twork);
@@ -250,65 +804,157 @@ static void limit_process(pid_t pid, double limit, int include_children)
         {
             /* Print CPU usage statistics every 10 cycles */
             if (c % 200 == 0)
-                printf("\n%9s%16s%16s%14s\n",
-                       "%CPU", "work quantum", "sleep quantum", "active rate");
+            {
+                printf("\n%9s%16s%16s%14s%16s%12s%14s%12s%14s",
+                       "%CPU", "work quantum", "sleep quantum", "active rate",
+                       "syscalls/cycle", "scan time", "resume time", "stop time",
+                       "wakeup delay");
+                if (include_children || pid == 0)
+                    printf("%8s%8s", "joined", "left");
+                printf(fork_tight ? "%10s\n" : "\n", "escaped");
+            }
 
             if (c % 10 == 0 && c > 0)
-                printf("%8.2f%%%13.0f us%13.0f us%13.2f%%\n",
-                       pcpu * 100, twork_total_nsec / 1000,
-                       tsleep_total_nsec / 1000, workingrate * 100);
-        }
-
-        /* Resume processes in the group */
-        node = pgroup.proclist->first;
-        while (node != NULL)
-        {
-            struct list_node *next_node = node->next;
-            const struct process *proc = (const struct process *)(node->data);
-            if (kill(proc->pid, SIGCONT) != 0)
             {
-                /* If the process is dead, remove it from the group */
-                if (verbose)
+                printf("%8.2f%%%13.0f us%13.0f us%13.2f%%%16.1f%9.0f us%11.0f us%9.0f us%11.0f us",
+                       pcpu * 100, twork_total_nsec / 1000,
+                       tsleep_total_nsec / 1000, workingrate * 100,
+                       (double)(syscall_count - last_syscall_count) / 10,
+                       pgroup.scan_time * 1000,
+                       resumes > 0 ? resume_time * 1000 / resumes : 0.0,
+                       stops > 0 ? stop_time * 1000 / stops : 0.0,
+                       wakeups > 0 ? wakeup_delay / 1000 / wakeups : 0.0);
+                if (include_children || pid == 0)
+                    printf("%8d%8d", joined, left);
+                printf(fork_tight ? "%10d\n" : "\n", escaped);
+                if (verbose > 1)
                 {
-                    char errbuf[100];
-                    sprintf(errbuf, "kill failed to send SIGCONT to process %ld",
-                            (long)proc->pid);
-                    perror(errbuf);
+                    int busiest = 0;
+                    for (i = 1; i < pgroup.hot.count; i++)
+                    {
+                        if (pgroup.hot.cpu_usage[i] > pgroup.hot.cpu_usage[busiest])
+                            busiest = i;
+                    }
+                    if (pgroup.hot.count > 0)
+                        print_thread_usage(pgroup.hot.pid[busiest]);
                 }
-                delete_node(pgroup.proclist, node);
-                remove_process(&pgroup, proc->pid);
+                last_syscall_count = syscall_count;
+                escaped = joined = left = 0;
+                resume_time = stop_time = 0;
+                resumes = stops = 0;
+                wakeup_delay = 0;
+                wakeups = 0;
+            }
+            else if (c % 10 == 0)
+            {
+                last_syscall_count = syscall_count;
+                escaped = joined = left = 0;
+                resume_time = stop_time = 0;
+                resumes = stops = 0;
+                wakeup_delay = 0;
+                wakeups = 0;
             }
-            node = next_node;
         }
 
-        /* Allow processes to run during the work slice */
-        sleep_timespec(&twork);
-
-        if (tsleep.tv_nsec > 0 || tsleep.tv_sec > 0)
+        /* Resume processes in the group */
+        if (get_time(&phase_start))
+        {
+            exit(EXIT_FAILURE);
+        }
+        if (use_freezer && cgroup_freezer_set(&freezer, 0) != 0)
+            use_freezer = fall_back_to_signals(&freezer);
+        if (!use_freezer)
         {
-            /* Stop processes during the sleep slice if needed */
             node = pgroup.proclist->first;
             while (node != NULL)
             {
                 struct list_node *next_node = node->next;
                 const struct process *proc = (const struct process *)(node->data);
-                if (kill(proc->pid, SIGSTOP) != 0)
+                syscall_count++;
+                if (signal_process(proc, SIGCONT) != 0)
                 {
                     /* If the process is dead, remove it from the group */
                     if (verbose)
                     {
                         char errbuf[100];
-                        sprintf(errbuf, "kill failed to send SIGSTOP to process %ld",
+                        sprintf(errbuf, "kill failed to send SIGCONT to process %ld",
                                 (long)proc->pid);
                         perror(errbuf);
                     }
-                    delete_node(pgroup.proclist, node);
                     remove_process(&pgroup, proc->pid);
                 }
                 node = next_node;
             }
+        }
+        if (get_time(&phase_end))
+        {
+            exit(EXIT_FAILURE);
+        }
+        resume_time += timediff_in_ms(&phase_end, &phase_start);
+        resumes++;
+
+        /* Allow processes to run during the work slice */
+        wait_deadline(&loop, &twork);
+        wakeup_delay += loop.lateness;
+        wakeups++;
+        if (quit_flag)
+            break;
+
+        /* Add the processes forked during the work slice, so they are stopped too */
+        process_group_apply_events(&pgroup);
+        if (use_freezer && sync_freezer(&freezer) != 0)
+            use_freezer = fall_back_to_signals(&freezer);
+        if (confined)
+            sync_affinity(&affinity);
+
+        if (tsleep.tv_nsec > 0 || tsleep.tv_sec > 0)
+        {
+            /* Stop processes during the sleep slice if needed */
+            if (get_time(&phase_start))
+            {
+                exit(EXIT_FAILURE);
+            }
+            if (use_freezer && cgroup_freezer_set(&freezer, 1) != 0)
+                use_freezer = fall_back_to_signals(&freezer);
+            if (!use_freezer)
+            {
+                node = pgroup.proclist->first;
+                while (node != NULL)
+                {
+                    struct list_node *next_node = node->next;
+                    const struct process *proc = (const struct process *)(node->data);
+                    syscall_count++;
+                    if (signal_process(proc, SIGSTOP) != 0)
+                    {
+                        /* If the process is dead, remove it from the group */
+                        if (verbose)
+                        {
+                            char errbuf[100];
+                            sprintf(errbuf, "kill failed to send SIGSTOP to process %ld",
+                                    (long)proc->pid);
+                            perror(errbuf);
+                        }
+                        remove_process(&pgroup, proc->pid);
+                    }
+                    node = next_node;
+                }
+            }
+            if (get_time(&phase_end))
+            {
+                exit(EXIT_FAILURE);
+            }
+            stop_time += timediff_in_ms(&phase_end, &phase_start);
+            stops++;
+
+            /* Stop the children forked while the group was being stopped,
+               those of a frozen cgroup are born frozen */
+            if (fork_tight && !use_freezer)
+                escaped += stop_new_processes();
+
             /* Allow the processes to sleep during the sleep slice */
-            sleep_timespec(&tsleep);
+            wait_deadline(&loop, &tsleep);
+            wakeup_delay += loop.lateness;
+            wakeups++;
         }
         c = (c + 1) % 200;
     }
@@ -319,10 +965,21 @@ static void limit_process(pid_t pid, double limit, int include_children)
         for (node = pgroup.proclist->first; node != NULL; node = node->next)
         {
             const struct process *p = (const struct process *)(node->data);
-            kill(p->pid, SIGCONT);
+            signal_process(p, SIGCONT);
         }
     }
 
+    /* Give back their affinity to the processes */
+    if (confined)
+        close_process_affinity(&affinity);
+
+    /* Thaw the processes and move them back to their cgroups */
+    if (use_freezer)
+        close_cgroup_freezer(&freezer);
+
+    /* Give back the termination signals to their handlers */
+    close_event_loop(&loop);
+
     /* Clean up the process group */
     close_process_group(&pgroup);
 }
@@ -346,26 +1003,49 @@ int main(int argc, char *argv[])
     char *exe = NULL;
     double perclimit = 0.0;
     int exe_ok = 0;
+    int cgroup_ok = 0;
+    const char *cgroup_path = NULL;
+    /* Mode of matching of the executable name, indexed by MATCH_* value */
+    static const char *const match_modes[] = {"name", "exe", "glob", "regex"};
+    int match_mode = MATCH_NAME;
+    /* Name of the backends, indexed by BACKEND_* value */
+    static const char *const backends[] = {"signal", "freezer", "cpumax"};
+    static const char *const estimators[] = {"ewma", "window", "kalman"};
+    struct process_matcher matcher;
     int pid_ok = 0;
     int limit_ok = 0;
     pid_t pid = 0;
     int include_children = 0;
+    int aggregate = 0;
     int command_mode;
+    long threads;
 
     /* For parsing command-line options */
     int next_option;
     int option_index = 0;
 
     /* Define valid short and long command-line options */
-    const char *short_options = "+p:e:l:vzih";
+    const char *short_options = "+p:e:m:g:l:b:C:G:u:T:t:vzaifEAh";
     /* An array describing valid long options */
     const struct option long_options[] = {
         {"pid", required_argument, NULL, 'p'},
         {"exe", required_argument, NULL, 'e'},
+        {"match", required_argument, NULL, 'm'},
+        {"cgroup", required_argument, NULL, 'g'},
         {"limit", required_argument, NULL, 'l'},
         {"verbose", no_argument, NULL, 'v'},
         {"lazy", no_argument, NULL, 'z'},
+        {"all", no_argument, NULL, 'a'},
         {"include-children", no_argument, NULL, 'i'},
+        {"fork-tight", no_argument, NULL, 'f'},
+        {"events", no_argument, NULL, 'E'},
+        {"backend", required_argument, NULL, 'b'},
+        {"affinity", no_argument, NULL, 'A'},
+        {"controller", required_argument, NULL, 'C'},
+        {"gains", required_argument, NULL, 'G'},
+        {"estimator", required_argument, NULL, 'u'},
+        {"tau", required_argument, NULL, 'T'},
+        {"threads", required_argument, NULL, 't'},
         {"help", no_argument, NULL, 'h'},
         {0, 0, 0, 0}};
 
@@ -398,7 +1078,7 @@ int main(int argc, char *argv[])
     do
     {
         next_option = getopt_long(argc, argv, short_options, long_options, &option_index);
-        if (strchr("pel", next_option) != NULL && optarg[0] == '-')
+        if (strchr("pemglbCGuTt", next_option) != NULL && optarg[0] == '-')
         {
             fprintf(stderr, "%s: option '%c' requires an argument.\n",
                     argv[0], next_option);
@@ -417,23 +1097,128 @@ int main(int argc, char *argv[])
             exe = optarg;
             exe_ok = 1;
             break;
+        case 'm':
+            /* Store how the executable name is matched */
+            for (match_mode = 0; match_mode < 4; match_mode++)
+            {
+                if (strcmp(optarg, match_modes[match_mode]) == 0)
+                    break;
+            }
+            if (match_mode == 4)
+            {
+                fprintf(stderr, "Error: Invalid value for argument MODE\n");
+                print_usage_and_exit(stderr, EXIT_FAILURE);
+            }
+            break;
+        case 'g':
+            /* Store the cgroup provided by the user */
+            cgroup_path = optarg;
+            cgroup_ok = 1;
+            break;
         case 'l':
             /* Store the CPU limit percentage provided by the user */
             perclimit = strtod(optarg, &endptr);
             limit_ok = endptr != optarg && *endptr == '\0';
             break;
         case 'v':
-            /* Enable verbose mode */
-            verbose = 1;
+            /* Enable verbose mode, with the threads if given twice */
+            verbose++;
             break;
         case 'z':
             /* Enable lazy mode */
             lazy = 1;
             break;
+        case 'a':
+            /* Limit all the matching processes together */
+            aggregate = 1;
+            break;
         case 'i':
             /* Include child processes in the limit */
             include_children = 1;
             break;
+        case 'f':
+            /* Stop the processes forked during a stop phase */
+            fork_tight = 1;
+            break;
+        case 'E':
+            /* Track processes through kernel events */
+            use_events = 1;
+            break;
+        case 'b':
+            /* Store how the processes are stopped */
+            for (backend = 0; backend < 3; backend++)
+            {
+                if (strcmp(optarg, backends[backend]) == 0)
+                    break;
+            }
+            if (backend == 3)
+            {
+                fprintf(stderr, "Error: Invalid value for argument MODE\n");
+                print_usage_and_exit(stderr, EXIT_FAILURE);
+            }
+            break;
+        case 'A':
+            /* Confine the processes to the CPUs they may use */
+            use_affinity = 1;
+            break;
+        case 'C':
+            /* Store how the working rate is adjusted */
+            if (strcmp(optarg, "pi") == 0)
+                controller_mode = CONTROLLER_PI;
+            else if (strcmp(optarg, "ratio") == 0)
+                controller_mode = CONTROLLER_RATIO;
+            else
+            {
+                fprintf(stderr, "Error: Invalid value for argument MODE\n");
+                print_usage_and_exit(stderr, EXIT_FAILURE);
+            }
+            break;
+        case 'G':
+            /* Store the gains of the PI controller */
+            gain_kp = strtod(optarg, &endptr);
+            if (*endptr == ',')
+                gain_ki = strtod(endptr + 1, &endptr);
+            if (*endptr == ',' && gain_ki >= 0)
+                gain_kd = strtod(endptr + 1, &endptr);
+            if (*endptr != '\0' || gain_kp < 0 || gain_ki < 0 || gain_kd < 0)
+            {
+                fprintf(stderr, "Error: Invalid value for argument GAINS\n");
+                print_usage_and_exit(stderr, EXIT_FAILURE);
+            }
+            break;
+        case 'u':
+            /* Store how the CPU usage is estimated */
+            for (estimator_type = 0; estimator_type < 3; estimator_type++)
+            {
+                if (strcmp(optarg, estimators[estimator_type]) == 0)
+                    break;
+            }
+            if (estimator_type == 3)
+            {
+                fprintf(stderr, "Error: Invalid value for argument MODE\n");
+                print_usage_and_exit(stderr, EXIT_FAILURE);
+            }
+            break;
+        case 'T':
+            /* Store the time constant of the estimation */
+            estimator_tau = strtod(optarg, &endptr) * 1000;
+            if (endptr == optarg || *endptr != '\0' || !(estimator_tau > 0))
+            {
+                fprintf(stderr, "Error: Invalid value for argument TAU\n");
+                print_usage_and_exit(stderr, EXIT_FAILURE);
+            }
+            break;
+        case 't':
+            /* Store the number of threads scanning /proc */
+            threads = strtol(optarg, &endptr, 10);
+            if (endptr == optarg || *endptr != '\0' || threads < 1)
+            {
+                fprintf(stderr, "Error: Invalid value for argument THREADS\n");
+                print_usage_and_exit(stderr, EXIT_FAILURE);
+            }
+            /* more threads than CPUs would only contend */
+            set_scan_threads((int)MIN(threads, (long)NCPU));
+            break;
         case 'h':
             /* Print usage information and exit */
             print_usage_and_exit(stdout, EXIT_SUCCESS);
@@ -480,13 +1265,36 @@ int main(int argc, char *argv[])
     /* Determine if a command was provided */
     command_mode = optind < argc;
 
-    /* Ensure exactly one target process (pid, executable, or command) is specified */
-    if (exe_ok + pid_ok + command_mode != 1)
+    /* Ensure exactly one target (pid, executable, cgroup or command) is specified */
+    if (exe_ok + pid_ok + cgroup_ok + command_mode != 1)
+    {
+        fprintf(stderr, "Error: You must specify exactly one target process by name, pid, cgroup or command line\n");
+        print_usage_and_exit(stderr, EXIT_FAILURE);
+    }
+
+    if (aggregate && !exe_ok)
     {
-        fprintf(stderr, "Error: You must specify exactly one target process by name, pid, or command line\n");
+        fprintf(stderr, "Error: -a requires a target process given by -e\n");
         print_usage_and_exit(stderr, EXIT_FAILURE);
     }
 
+    /* Compile the pattern of the executable name once */
+    if (exe_ok && process_matcher_init(&matcher, match_mode, exe) != 0)
+    {
+        if (match_mode == MATCH_EXE)
+            fprintf(stderr, "Error: Cannot access the executable file '%s'\n", exe);
+        else
+            fprintf(stderr, "Error: Invalid regular expression '%s'\n", exe);
+        exit(EXIT_FAILURE);
+    }
+
+    /* Open the cgroup once, its processes are listed at every scan */
+    if (cgroup_ok && (cgroup_fd = open_cgroup(cgroup_path)) < 0)
+    {
+        fprintf(stderr, "Error: '%s' is not a cgroup v2 directory\n", cgroup_path);
+        exit(EXIT_FAILURE);
+    }
+
     /* Set up signal handlers for SIGINT and SIGTERM */
     sa.sa_handler = &sig_handler;
     sa.sa_flags = 0;
@@ -498,6 +1306,14 @@ int main(int argc, char *argv[])
     if (verbose)
         printf("%d cpu detected\n", NCPU);
 
+    /* Subscribe to process events, which are useless for a single process */
+    if (use_events && (include_children || exe_ok || cgroup_ok))
+    {
+        events_fd = open_process_events();
+        if (events_fd < 0)
+            fprintf(stderr, "Warning: process events are not available, scanning /proc instead\n");
+    }
+
     /* Handle command mode (run a command and limit its CPU usage) */
     if (command_mode)
     {
@@ -560,14 +1376,22 @@ int main(int argc, char *argv[])
                 /* Limiter process controls the CPU usage of the child process */
                 if (verbose)
                     printf("Limiting process %ld\n", (long)child);
-                limit_process(child, limit, include_children);
+                limit_process(child, NULL, limit, include_children);
                 exit(EXIT_SUCCESS);
             }
         }
     }
 
+    /* Limit all the instances of the executable together */
+    if (aggregate)
+        limit_process(0, &matcher, limit, include_children);
+
+    /* Limit all the processes of the cgroup together */
+    if (cgroup_ok)
+        limit_process(0, NULL, limit, 1);
+
     /* Monitor and limit the target process specified by PID or executable name */
-    while (!quit_flag)
+    while (!aggregate && !cgroup_ok && !quit_flag)
     {
         pid_t ret = 0;
         if (pid_ok)
@@ -582,7 +1406,7 @@ int main(int argc, char *argv[])
         else
         {
             /* Search for the process by executable name */
-            ret = find_process_by_name(exe);
+            ret = find_process_by_matcher(&matcher);
             if (ret == 0)
             {
                 printf("No process found\n");
@@ -607,16 +1431,21 @@ int main(int argc, char *argv[])
                 exit(EXIT_FAILURE);
             }
             printf("Process %ld found\n", (long)pid);
-            limit_process(pid, limit, include_children);
+            limit_process(pid, NULL, limit, include_children);
         }
 
         /* Break the loop if lazy mode is enabled or quit flag is set */
         if (lazy || quit_flag)
             break;
 
-        /* Wait for 2 seconds before the next process search */
-        sleep_timespec(&wait_time);
+        /* Wait for up to 2 seconds before the next process search */
+        wait_for_target(exe_ok ? &matcher : NULL, &wait_time);
     }
 
+    if (exe_ok)
+        process_matcher_destroy(&matcher);
+    if (cgroup_fd >= 0)
+        close(cgroup_fd);
+    close_process_events(events_fd);
     return 0;
 }
@@ -0,0 +1,164 @@
+/**
+ *
+ * cpulimit - a CPU limiter for Linux
+ *
+ * Copyright (C) 2005-2012, by:  Angelo Marletta <angelo dot marletta at gmail dot com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <math.h>
+
+#include "estimator.h"
+#include "util.h"
+
+/* Initial variance of the error of the CPU time measured by the Kalman
+   filter (in ms^2), that of a clock tick of 10 ms */
+#define KALMAN_INITIAL_NOISE 16.0
+
+/* Lower bound of the variance of the measurement error (in ms^2) */
+#define KALMAN_MIN_NOISE 1e-3
+
+/* Number of standard deviations beyond which an innovation is taken as a
+   change of the load rather than noise */
+#define KALMAN_GATE 3.0
+
+/* The variance of the measurement error is estimated over this many time constants */
+#define KALMAN_NOISE_TAUS 10.0
+
+int usage_estimator_init(struct usage_estimator *e, int type, double tau)
+{
+    if ((type != ESTIMATOR_EWMA && type != ESTIMATOR_WINDOW && type != ESTIMATOR_KALMAN) ||
+        !(tau > 0))
+        return -1;
+    e->type = type;
+    e->tau = tau;
+    return 0;
+}
+
+void usage_estimate_init(struct usage_estimate *s)
+{
+    s->head = 0;
+    s->count = 0;
+    s->pending_cputime = 0;
+    s->pending_dt = 0;
+    s->noise = KALMAN_INITIAL_NOISE;
+    s->variance = 0;
+}
+
+/* weight of a sample covering dt in an average with time constant tau */
+static double ewma_weight(double dt, double tau)
+{
+    return 1.0 - exp(-dt / tau);
+}
+
+static double update_window(const struct usage_estimator *e, struct usage_estimate *s,
+                            double cputime, double dt)
+{
+    /* a sample joins the newest bucket while it stays short enough for the
+       buckets to span the time constant before the ring is full */
+    const double bucket = e->tau / (ESTIMATOR_WINDOW_SAMPLES / 2 - 1);
+    double total_cputime = 0, total_dt = 0;
+    int i, tail = (s->head + s->count - 1) % ESTIMATOR_WINDOW_SAMPLES;
+    if (s->count > 0 && s->dt[tail] + dt <= bucket)
+    {
+        s->cputime[tail] += cputime;
+        s->dt[tail] += dt;
+    }
+    else
+    {
+        if (s->count == ESTIMATOR_WINDOW_SAMPLES)
+        {
+            s->head = (s->head + 1) % ESTIMATOR_WINDOW_SAMPLES;
+            s->count--;
+        }
+        tail = (s->head + s->count) % ESTIMATOR_WINDOW_SAMPLES;
+        s->cputime[tail] = cputime;
+        s->dt[tail] = dt;
+        s->count++;
+    }
+    for (i = 0; i < s->count; i++)
+        total_dt += s->dt[(s->head + i) % ESTIMATOR_WINDOW_SAMPLES];
+    /* drop the oldest buckets as long as the rest spans the time constant */
+    while (s->count > 1 && total_dt - s->dt[s->head] >= e->tau)
+    {
+        total_dt -= s->dt[s->head];
+        s->head = (s->head + 1) % ESTIMATOR_WINDOW_SAMPLES;
+        s->count--;
+    }
+    for (i = 0; i < s->count; i++)
+        total_cputime += s->cputime[(s->head + i) % ESTIMATOR_WINDOW_SAMPLES];
+    return total_cputime / total_dt;
+}
+
+/* random walk of the usage measured with an error on the CPU time. The
+   process noise makes the gain settle to dt / tau like the moving average,
+   a change of the load opens it again */
+static double update_kalman(const struct usage_estimator *e, struct usage_estimate *s,
+                            double estimate, double cputime, double dt)
+{
+    double measurement_variance = s->noise / (dt * dt);
+    double innovation = cputime / dt - estimate;
+    double gain, predicted;
+    s->variance += s->noise / (e->tau * e->tau);
+    predicted = s->variance;
+    if (innovation * innovation > KALMAN_GATE * KALMAN_GATE * (predicted + measurement_variance))
+    {
+        s->variance += innovation * innovation;
+    }
+    else
+    {
+        /* the expected square of the innovation is the sum of the variances */
+        double noise = (innovation * innovation - predicted) * dt * dt;
+        s->noise += ewma_weight(dt, KALMAN_NOISE_TAUS * e->tau) * (noise - s->noise);
+        s->noise = MAX(s->noise, KALMAN_MIN_NOISE);
+    }
+    gain = s->variance / (s->variance + measurement_variance);
+    s->variance *= 1.0 - gain;
+    return MAX(estimate + gain * innovation, 0.0);
+}
+
+double usage_estimator_update(const struct usage_estimator *e, struct usage_estimate *s,
+                              double estimate, double cputime, double dt)
+{
+    if (estimate < 0)
+    {
+        /* a few clock ticks are needed for a meaningful first estimation */
+        s->pending_cputime += cputime;
+        s->pending_dt += dt;
+        if (s->pending_dt < ESTIMATOR_MIN_SPAN)
+            return -1;
+        cputime = s->pending_cputime;
+        dt = s->pending_dt;
+        s->pending_cputime = s->pending_dt = 0;
+        s->variance = s->noise / (dt * dt);
+        if (e->type == ESTIMATOR_WINDOW)
+            return update_window(e, s, cputime, dt);
+        return cputime / dt;
+    }
+    switch (e->type)
+    {
+    case ESTIMATOR_WINDOW:
+        return update_window(e, s, cputime, dt);
+    case ESTIMATOR_KALMAN:
+        return update_kalman(e, s, estimate, cputime, dt);
+    default:
+        return estimate + ewma_weight(dt, e->tau) * (cputime / dt - estimate);
+    }
+}
@@ -0,0 +1,117 @@
+/**
+ *
+ * cpulimit - a CPU limiter for Linux
+ *
+ * Copyright (C) 2005-2012, by:  Angelo Marletta <angelo dot marletta at gmail dot com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __ESTIMATOR_H
+#define __ESTIMATOR_H
+
+/* Exponentially weighted moving average, the weight of a sample growing with its interval */
+#define ESTIMATOR_EWMA 0
+
+/* Exact average over a sliding window spanning the time constant */
+#define ESTIMATOR_WINDOW 1
+
+/* Kalman filter adapting its gain to the noise and to the changes of the load */
+#define ESTIMATOR_KALMAN 2
+
+/* Default time constant of the estimators (in ms) */
+#define ESTIMATOR_DEFAULT_TAU 1200
+
+/* Minimum span of the samples the first estimation is made from (in ms),
+   ten clock ticks of 10 ms */
+#define ESTIMATOR_MIN_SPAN 100
+
+/* Number of buckets of a sliding window. The short samples are summed in
+   buckets, so that the window spans the time constant with a bounded memory
+   and overshoots it by at most a seventh of it */
+#define ESTIMATOR_WINDOW_SAMPLES 16
+
+/**
+ * Structure representing the configuration of the estimation of the CPU
+ * usage of the processes.
+ */
+struct usage_estimator
+{
+    /* One of the ESTIMATOR_* values */
+    int type;
+
+    /* Time constant (in ms): the time constant of the moving average, the
+       span of the window, or the time constant of the Kalman filter once its
+       gain has settled */
+    double tau;
+};
+
+/**
+ * Structure holding the state of the estimation of the CPU usage of a
+ * process, besides the estimation itself.
+ */
+struct usage_estimate
+{
+    /* Buckets of the sliding window, oldest first from head: CPU time used
+       and interval (in ms) */
+    double cputime[ESTIMATOR_WINDOW_SAMPLES];
+    double dt[ESTIMATOR_WINDOW_SAMPLES];
+    int head;
+    int count;
+
+    /* CPU time used and duration of the samples gathered before the first
+       estimation (in ms) */
+    double pending_cputime;
+    double pending_dt;
+
+    /* Variance of the error of the Kalman estimation */
+    double variance;
+
+    /* Variance of the error of the CPU time measured by the Kalman filter (in ms^2) */
+    double noise;
+};
+
+/**
+ * Initializes the configuration of an estimator.
+ *
+ * @param e The estimator to initialize.
+ * @param type One of the ESTIMATOR_* values.
+ * @param tau Time constant (in ms).
+ * @return 0 on success, -1 if the type or the time constant is invalid.
+ */
+int usage_estimator_init(struct usage_estimator *e, int type, double tau);
+
+/**
+ * Initializes the state of the estimation of the CPU usage of a process.
+ *
+ * @param s The state to initialize.
+ */
+void usage_estimate_init(struct usage_estimate *s);
+
+/**
+ * Updates the estimation of the CPU usage of a process with a new sample.
+ * The first estimation is made once the samples span ESTIMATOR_MIN_SPAN.
+ *
+ * @param e The estimator.
+ * @param s The state of the estimation of the process.
+ * @param estimate The previous estimation, negative if there is none yet.
+ * @param cputime CPU time used by the process during the interval (in ms).
+ * @param dt Duration of the interval (in ms), greater than 0.
+ * @return The new estimation of the CPU usage, -1 if there is none yet.
+ */
+double usage_estimator_update(const struct usage_estimator *e, struct usage_estimate *s,
+                              double estimate, double cputime, double dt);
+
+#endif
@@ -0,0 +1,300 @@
+/**
+ *
+ * cpulimit - a CPU limiter for Linux
+ *
+ * Copyright (C) 2005-2012, by:  Angelo Marletta <angelo dot marletta at gmail dot com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "event_loop.h"
+#include "util.h"
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#endif
+
+/* Clock of the deadlines, which is not changed by the adjustments of the wall time */
+#if defined(CLOCK_MONOTONIC)
+#define loop_time(ts) clock_gettime(CLOCK_MONOTONIC, (ts))
+#else
+#define loop_time(ts) get_time(ts)
+#endif
+
+static void add_duration(struct timespec *t, const struct timespec *d)
+{
+    t->tv_sec += d->tv_sec;
+    t->tv_nsec += d->tv_nsec;
+    if (t->tv_nsec >= 1000000000L)
+    {
+        t->tv_sec++;
+        t->tv_nsec -= 1000000000L;
+    }
+}
+
+static double diff_in_ns(const struct timespec *end, const struct timespec *start)
+{
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 + (double)(end->tv_nsec - start->tv_nsec);
+}
+
+static void block_signals(struct event_loop *loop)
+{
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, &loop->saved_mask);
+}
+
+/* sleep until the deadline, for the loops without epoll */
+static int sleep_until(struct event_loop *loop)
+{
+    struct timespec now;
+#if defined(__linux__) && defined(CLOCK_MONOTONIC)
+    syscall_count++;
+    if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &loop->deadline, NULL) != 0)
+        return EVENT_LOOP_TIMEOUT;
+#else
+    struct timespec remaining;
+    double ns;
+    if (loop_time(&now))
+        return -1;
+    ns = diff_in_ns(&loop->deadline, &now);
+    if (ns > 0)
+    {
+        remaining.tv_sec = (time_t)(ns / 1e9);
+        remaining.tv_nsec = (long)(ns - (double)remaining.tv_sec * 1e9);
+        syscall_count++;
+        /* a signal interrupts the sleep, its handler tells the loop to quit */
+        if (nanosleep(&remaining, NULL) != 0)
+            return EVENT_LOOP_TIMEOUT;
+    }
+#endif
+    if (loop_time(&now))
+        return -1;
+    loop->lateness = diff_in_ns(&now, &loop->deadline);
+    return EVENT_LOOP_TIMEOUT;
+}
+
+#if defined(__linux__)
+
+int open_event_loop(struct event_loop *loop)
+{
+    struct epoll_event ev;
+    sigset_t mask;
+    loop->epoll_fd = loop->timer_fd = loop->signal_fd = -1;
+    loop->lateness = 0;
+    loop->ready_fd = -1;
+    event_loop_restart(loop);
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    block_signals(loop);
+    loop->signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    loop->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->signal_fd >= 0 && loop->timer_fd >= 0 && loop->epoll_fd >= 0)
+    {
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = loop->signal_fd;
+        if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->signal_fd, &ev) == 0)
+        {
+            ev.data.fd = loop->timer_fd;
+            if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->timer_fd, &ev) == 0)
+                return 0;
+        }
+    }
+    /* fall back to sleeping, the signals are handled by their handlers again */
+    sigprocmask(SIG_SETMASK, &loop->saved_mask, NULL);
+    if (loop->signal_fd >= 0)
+        close(loop->signal_fd);
+    loop->signal_fd = -1;
+    close_event_loop(loop);
+    return -1;
+}
+
+int event_loop_watch(struct event_loop *loop, int fd)
+{
+    struct epoll_event ev;
+    if (loop->epoll_fd < 0)
+    {
+        errno = ENOSYS;
+        return -1;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    syscall_count++;
+    return epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/* read the pending signals and timer expirations of the loop */
+static int drain(int fd, void *buf, size_t size)
+{
+    ssize_t n;
+    syscall_count++;
+    while ((n = read(fd, buf, size)) < 0 && errno == EINTR)
+        syscall_count++;
+    return n == (ssize_t)size ? 0 : -1;
+}
+
+/* wait for the deadline, or only check the pending events if it is past */
+static int wait_events(struct event_loop *loop, int overrun)
+{
+    struct itimerspec timer;
+    struct timespec now;
+    memset(&timer, 0, sizeof(timer));
+    timer.it_value = loop->deadline;
+    if (!overrun)
+    {
+        syscall_count++;
+        if (timerfd_settime(loop->timer_fd, TFD_TIMER_ABSTIME, &timer, NULL) != 0)
+            return -1;
+    }
+    for (;;)
+    {
+        struct epoll_event ev;
+        int n;
+        syscall_count++;
+        n = epoll_wait(loop->epoll_fd, &ev, 1, overrun ? 0 : -1);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        if (n == 0 && overrun)
+            return EVENT_LOOP_TIMEOUT;
+        if (n == 0)
+            continue;
+        if (ev.data.fd == loop->signal_fd)
+        {
+            struct signalfd_siginfo info;
+            if (drain(loop->signal_fd, &info, sizeof(info)) == 0)
+                return EVENT_LOOP_QUIT;
+        }
+        else if (ev.data.fd == loop->timer_fd)
+        {
+            uint64_t expirations;
+            /* an expiration of a previous deadline may still be pending */
+            if (drain(loop->timer_fd, &expirations, sizeof(expirations)) != 0 || overrun)
+                continue;
+            if (loop_time(&now))
+                return -1;
+            if (diff_in_ns(&now, &loop->deadline) >= 0)
+                break;
+        }
+        else
+        {
+            loop->ready_fd = ev.data.fd;
+            return EVENT_LOOP_READY;
+        }
+    }
+    loop->lateness = diff_in_ns(&now, &loop->deadline);
+    return EVENT_LOOP_TIMEOUT;
+}
+
+#else
+
+int open_event_loop(struct event_loop *loop)
+{
+    loop->epoll_fd = loop->timer_fd = loop->signal_fd = -1;
+    loop->lateness = 0;
+    loop->ready_fd = -1;
+    event_loop_restart(loop);
+    errno = ENOSYS;
+    return -1;
+}
+
+int event_loop_watch(struct event_loop *loop, int fd)
+{
+    (void)loop;
+    (void)fd;
+    errno = ENOSYS;
+    return -1;
+}
+
+static int wait_events(struct event_loop *loop, int overrun)
+{
+    return overrun ? EVENT_LOOP_TIMEOUT : sleep_until(loop);
+}
+
+#endif
+
+void event_loop_restart(struct event_loop *loop)
+{
+    if (loop_time(&loop->deadline))
+        exit(EXIT_FAILURE);
+}
+
+int event_loop_wait(struct event_loop *loop, const struct timespec *duration)
+{
+    struct timespec now;
+    loop->ready_fd = -1;
+    if (duration != NULL)
+        add_duration(&loop->deadline, duration);
+    if (loop_time(&now))
+        return -1;
+    if (diff_in_ns(&loop->deadline, &now) <= 0)
+    {
+        /* the cycle overran its deadline: start again from now, still
+           noticing the signals and the descriptors ready meanwhile */
+        loop->lateness = diff_in_ns(&now, &loop->deadline);
+        loop->deadline = now;
+        return loop->epoll_fd < 0 ? EVENT_LOOP_TIMEOUT : wait_events(loop, 1);
+    }
+    if (loop->epoll_fd < 0)
+        return sleep_until(loop);
+    return wait_events(loop, 0);
+}
+
+void event_loop_suspend(struct event_loop *loop)
+{
+    if (loop->signal_fd >= 0)
+        sigprocmask(SIG_SETMASK, &loop->saved_mask, NULL);
+}
+
+void event_loop_resume(struct event_loop *loop)
+{
+    if (loop->signal_fd >= 0)
+        block_signals(loop);
+    event_loop_restart(loop);
+}
+
+void close_event_loop(struct event_loop *loop)
+{
+    if (loop->epoll_fd >= 0)
+        close(loop->epoll_fd);
+    if (loop->timer_fd >= 0)
+        close(loop->timer_fd);
+    if (loop->signal_fd >= 0)
+    {
+        close(loop->signal_fd);
+        sigprocmask(SIG_SETMASK, &loop->saved_mask, NULL);
+    }
+    loop->epoll_fd = loop->timer_fd = loop->signal_fd = -1;
+}
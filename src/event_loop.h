@@ -0,0 +1,132 @@
+/**
+ *
+ * cpulimit - a CPU limiter for Linux
+ *
+ * Copyright (C) 2005-2012, by:  Angelo Marletta <angelo dot marletta at gmail dot com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __EVENT_LOOP_H
+#define __EVENT_LOOP_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <signal.h>
+#include <time.h>
+
+/* The deadline has been reached */
+#define EVENT_LOOP_TIMEOUT 0
+
+/* SIGINT or SIGTERM has been received */
+#define EVENT_LOOP_QUIT 1
+
+/* A watched descriptor is readable, the deadline is still pending */
+#define EVENT_LOOP_READY 2
+
+/**
+ * Structure representing the loop waiting for the deadlines of the control
+ * cycle. On Linux an epoll instance waits at once for a timer armed with
+ * absolute deadlines on the monotonic clock, for SIGINT and SIGTERM through
+ * a signalfd, and for the descriptors watched by the caller. Elsewhere, or
+ * if these are not available, the loop sleeps until the deadlines.
+ */
+struct event_loop
+{
+    /* epoll instance, or -1 if the loop sleeps */
+    int epoll_fd;
+
+    /* Timer armed with the deadlines */
+    int timer_fd;
+
+    /* Descriptor receiving SIGINT and SIGTERM, which are blocked */
+    int signal_fd;
+
+    /* Signal mask to restore when the loop is closed or suspended */
+    sigset_t saved_mask;
+
+    /* Current deadline, on the monotonic clock */
+    struct timespec deadline;
+
+    /* Delay between the last deadline reached and the wake up (in ns) */
+    double lateness;
+
+    /* Watched descriptor found readable by the last wait, or -1 */
+    int ready_fd;
+};
+
+/**
+ * Opens an event loop, whose first deadline is counted from now. SIGINT
+ * and SIGTERM are blocked until the loop is closed, so that they are only
+ * received by the loop.
+ *
+ * @param loop The loop to open.
+ * @return 0 on success, -1 if the loop can only sleep (it is usable anyway).
+ */
+int open_event_loop(struct event_loop *loop);
+
+/**
+ * Counts the next deadline from now, after a wait outside of the loop.
+ *
+ * @param loop The loop.
+ */
+void event_loop_restart(struct event_loop *loop);
+
+/**
+ * Watches a descriptor, so that a wait ends when it is readable.
+ *
+ * @param loop The loop.
+ * @param fd The descriptor, which must stay open while it is watched.
+ * @return 0 on success, -1 on error (errno is ENOSYS if the loop sleeps).
+ */
+int event_loop_watch(struct event_loop *loop, int fd);
+
+/**
+ * Moves the deadline forward and waits until it is reached. A deadline
+ * already past is moved to now, so that a late cycle is not made up for.
+ *
+ * @param loop The loop.
+ * @param duration Time between the previous deadline and the new one,
+ *                 0 to go on waiting for the current one.
+ * @return One of the EVENT_LOOP_* values, or -1 on error.
+ */
+int event_loop_wait(struct event_loop *loop, const struct timespec *duration);
+
+/**
+ * Restores the signal mask, so that SIGINT and SIGTERM interrupt the waits
+ * made outside of the loop until event_loop_resume() is called.
+ *
+ * @param loop The loop.
+ */
+void event_loop_suspend(struct event_loop *loop);
+
+/**
+ * Blocks SIGINT and SIGTERM again after event_loop_suspend(), and counts
+ * the next deadline from now.
+ *
+ * @param loop The loop.
+ */
+void event_loop_resume(struct event_loop *loop);
+
+/**
+ * Closes the descriptors of an event loop and restores the signal mask.
+ *
+ * @param loop The loop to close.
+ */
+void close_event_loop(struct event_loop *loop);
+
+#endif
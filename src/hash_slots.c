@@ -0,0 +1,18 @@
+#include "hash_slots.h"
+
+int hash_slots_delete(void *table, int size, int slot,
+                      int (*home)(const void *table, int slot),
+                      void (*move)(void *table, int to, int from))
+{
+    int j, h, mask = size - 1;
+    for (j = (slot + 1) & mask; (h = home(table, j)) >= 0; j = (j + 1) & mask)
+    {
+        /* the entry can fill the hole if its home slot is not in (slot, j] */
+        if (((j - h) & mask) >= ((j - slot) & mask))
+        {
+            move(table, slot, j);
+            slot = j;
+        }
+    }
+    return slot;
+}
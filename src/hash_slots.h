@@ -0,0 +1,22 @@
+#ifndef __HASH_SLOTS_H
+#define __HASH_SLOTS_H
+
+/**
+ * Empties a slot of an open addressing table with linear probing, shifting
+ * back the following entries of its probe sequence so that no tombstone is
+ * left. The table is only accessed through the callbacks, so that it can
+ * store its keys and values in separate arrays.
+ *
+ * @param table The table, passed to the callbacks
+ * @param size The number of slots of the table, a power of two
+ * @param slot The slot to empty
+ * @param home Returns the home slot of the entry stored in a slot,
+ *             or -1 if the slot is empty
+ * @param move Moves the entry stored in a slot (from) to another one (to)
+ * @return The slot left empty by the shifts, which the caller must clear
+ */
+int hash_slots_delete(void *table, int size, int slot,
+                      int (*home)(const void *table, int slot),
+                      void (*move)(void *table, int to, int from));
+
+#endif
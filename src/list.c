@@ -43,12 +43,17 @@ void init_list(struct list *l, int keysize)
     l->first = l->last = NULL;
     l->keysize = keysize;
     l->count = 0;
+    l->spare = NULL;
 }
 
 struct list_node *add_elem(struct list *l, void *elem)
 {
-    struct list_node *newnode = (struct list_node *)malloc(sizeof(struct list_node));
-    if (newnode == NULL)
+    struct list_node *newnode = l->spare;
+    if (newnode != NULL)
+    {
+        l->spare = newnode->next;
+    }
+    else if ((newnode = (struct list_node *)malloc(sizeof(struct list_node))) == NULL)
     {
         fprintf(stderr, "Memory allocation failed for the new list node\n");
         exit(EXIT_FAILURE);
@@ -91,7 +96,8 @@ void delete_node(struct list *l, struct list_node *node)
         node->next->previous = node->previous;
     }
     l->count--;
-    safe_free(node);
+    node->next = l->spare;
+    l->spare = node;
 }
 
 void destroy_node(struct list *l, struct list_node *node)
@@ -159,6 +165,16 @@ void *locate_elem(struct list *l, const void *elem)
     return (xlocate_elem(l, elem, 0, 0));
 }
 
+static void free_spare_nodes(struct list *l)
+{
+    while (l->spare != NULL)
+    {
+        struct list_node *tmp = l->spare;
+        l->spare = tmp->next;
+        free(tmp);
+    }
+}
+
 void clear_list(struct list *l)
 {
     while (l->first != NULL)
@@ -170,6 +186,7 @@ void clear_list(struct list *l)
     }
     l->last = NULL;
     l->count = 0;
+    free_spare_nodes(l);
 }
 
 void destroy_list(struct list *l)
@@ -184,4 +201,5 @@ void destroy_list(struct list *l)
     }
     l->last = NULL;
     l->count = 0;
+    free_spare_nodes(l);
 }
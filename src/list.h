@@ -57,6 +57,9 @@ struct list
 
     /* Count of elements in the list */
     int count;
+
+    /* Deleted nodes kept for reuse by add_elem(), chained by next */
+    struct list_node *spare;
 };
 
 /**
@@ -78,6 +81,7 @@ struct list_node *add_elem(struct list *l, void *elem);
 
 /**
  * Deletes a specified node from the list.
+ * The node is kept by the list, to be reused by the next addition.
  *
  * @param l Pointer to the list from which to delete the node.
  * @param node Pointer to the node to delete.
@@ -187,7 +191,7 @@ struct list_node *locate_node(struct list *l, const void *elem);
 void *locate_elem(struct list *l, const void *elem);
 
 /**
- * Deletes all elements in the list.
+ * Deletes all elements in the list and frees all the nodes.
  *
  * @param l Pointer to the list to clear.
  */
@@ -0,0 +1,234 @@
+/**
+ *
+ * cpulimit - a CPU limiter for Linux
+ *
+ * Copyright (C) 2005-2012, by:  Angelo Marletta <angelo dot marletta at gmail dot com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "process_events.h"
+#include "util.h"
+
+#if defined(__linux__)
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+
+/* Size of the receive buffer of the socket, so that bursts of forks fit */
+#define EVENTS_RCVBUF (1024 * 1024)
+
+/* Buffer able to hold one netlink message of the process connector */
+union events_buffer
+{
+    struct nlmsghdr header;
+    char data[4096];
+};
+
+/* Netlink address, passed to the socket functions as a generic one */
+union events_address
+{
+    struct sockaddr sa;
+    struct sockaddr_nl nl;
+};
+
+static int send_mcast_op(int fd, enum proc_cn_mcast_op op)
+{
+    union events_buffer buf;
+    struct nlmsghdr *nlh = &buf.header;
+    struct cn_msg *msg;
+    size_t len = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(op));
+
+    memset(&buf, 0, sizeof(buf));
+    nlh->nlmsg_len = (__u32)len;
+    nlh->nlmsg_type = NLMSG_DONE;
+    nlh->nlmsg_pid = (__u32)getpid();
+    msg = (struct cn_msg *)NLMSG_DATA(nlh);
+    msg->id.idx = CN_IDX_PROC;
+    msg->id.val = CN_VAL_PROC;
+    msg->len = (__u16)sizeof(op);
+    memcpy(msg->data, &op, sizeof(op));
+    syscall_count++;
+    return send(fd, nlh, len, 0) == (ssize_t)len ? 0 : -1;
+}
+
+int open_process_events(void)
+{
+    union events_address addr;
+    int fd, size = EVENTS_RCVBUF;
+
+    fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+    if (fd < 0)
+        return -1;
+    /* a larger queue makes overflows (and the resulting rescans) rarer */
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    memset(&addr, 0, sizeof(addr));
+    addr.nl.nl_family = AF_NETLINK;
+    addr.nl.nl_groups = CN_IDX_PROC;
+    if (bind(fd, &addr.sa, sizeof(addr.nl)) != 0 ||
+        send_mcast_op(fd, PROC_CN_MCAST_LISTEN) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* convert a message of the process connector, return 0 if it is not relevant */
+static int convert_event(const struct proc_event *ev, struct process_event *out)
+{
+    if (ev->what == PROC_EVENT_FORK)
+    {
+        /* skip the creation of threads */
+        if (ev->event_data.fork.child_pid != ev->event_data.fork.child_tgid)
+            return 0;
+        out->type = PROCESS_EVENT_FORK;
+        out->pid = ev->event_data.fork.child_tgid;
+        out->ppid = ev->event_data.fork.parent_tgid;
+        return 1;
+    }
+    if (ev->what == PROC_EVENT_EXEC)
+    {
+        out->type = PROCESS_EVENT_EXEC;
+        out->pid = ev->event_data.exec.process_tgid;
+        out->ppid = 0;
+        return 1;
+    }
+    if (ev->what == PROC_EVENT_EXIT)
+    {
+        /* skip the termination of threads */
+        if (ev->event_data.exit.process_pid != ev->event_data.exit.process_tgid)
+            return 0;
+        out->type = PROCESS_EVENT_EXIT;
+        out->pid = ev->event_data.exit.process_tgid;
+        out->ppid = 0;
+        return 1;
+    }
+    return 0;
+}
+
+int read_process_events(int fd, struct process_event *events, int max)
+{
+    int count = 0;
+    while (count < max)
+    {
+        union events_buffer buf;
+        union events_address from;
+        socklen_t fromlen = sizeof(from.nl);
+        const struct nlmsghdr *nlh;
+        ssize_t n;
+        size_t len;
+
+        n = recvfrom(fd, &buf, sizeof(buf), 0, &from.sa, &fromlen);
+        syscall_count++;
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if (errno == EINTR)
+                continue;
+            /* ENOBUFS: the queue overflowed and some events are lost */
+            return -1;
+        }
+        /* only trust messages coming from the kernel */
+        if (from.nl.nl_pid != 0)
+            continue;
+        len = (size_t)n;
+        nlh = &buf.header;
+        while (count < max && len >= sizeof(struct nlmsghdr) &&
+               nlh->nlmsg_len >= sizeof(struct nlmsghdr) && nlh->nlmsg_len <= len)
+        {
+            const struct cn_msg *msg = (const struct cn_msg *)NLMSG_DATA(nlh);
+            size_t size = NLMSG_ALIGN(nlh->nlmsg_len);
+            if (nlh->nlmsg_type != NLMSG_ERROR && nlh->nlmsg_type != NLMSG_NOOP &&
+                msg->id.idx == CN_IDX_PROC && msg->id.val == CN_VAL_PROC &&
+                msg->len >= sizeof(struct proc_event))
+            {
+                count += convert_event((const struct proc_event *)msg->data, &events[count]);
+            }
+            if (size >= len)
+                break;
+            len -= size;
+            nlh = (const struct nlmsghdr *)((const char *)nlh + size);
+        }
+    }
+    return count;
+}
+
+int wait_process_events(int fd, int timeout_ms)
+{
+    struct pollfd pfd;
+    int ret;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    ret = poll(&pfd, 1, timeout_ms);
+    syscall_count++;
+    if (ret < 0)
+        return errno == EINTR ? 0 : -1;
+    return ret > 0 ? 1 : 0;
+}
+
+void close_process_events(int fd)
+{
+    if (fd < 0)
+        return;
+    send_mcast_op(fd, PROC_CN_MCAST_IGNORE);
+    close(fd);
+}
+
+#else
+
+int open_process_events(void)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int read_process_events(int fd, struct process_event *events, int max)
+{
+    (void)fd;
+    (void)events;
+    (void)max;
+    errno = ENOSYS;
+    return -1;
+}
+
+int wait_process_events(int fd, int timeout_ms)
+{
+    (void)fd;
+    (void)timeout_ms;
+    errno = ENOSYS;
+    return -1;
+}
+
+void close_process_events(int fd)
+{
+    if (fd >= 0)
+        close(fd);
+}
+
+#endif
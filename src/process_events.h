@@ -0,0 +1,93 @@
+/**
+ *
+ * cpulimit - a CPU limiter for Linux
+ *
+ * Copyright (C) 2005-2012, by:  Angelo Marletta <angelo dot marletta at gmail dot com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __PROCESS_EVENTS_H
+#define __PROCESS_EVENTS_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <sys/types.h>
+
+/* A process has been created by fork() */
+#define PROCESS_EVENT_FORK 1
+
+/* A process has called exec() */
+#define PROCESS_EVENT_EXEC 2
+
+/* A process has exited */
+#define PROCESS_EVENT_EXIT 3
+
+/**
+ * Structure representing a process event reported by the kernel.
+ */
+struct process_event
+{
+    /* Type of the event (one of the PROCESS_EVENT_* values) */
+    int type;
+
+    /* Process ID the event is about (the new process for a fork) */
+    pid_t pid;
+
+    /* Parent Process ID (only meaningful for a fork) */
+    pid_t ppid;
+};
+
+/**
+ * Subscribes to the fork, exec and exit events of all processes.
+ * On Linux this uses the netlink process connector, which requires the
+ * CAP_NET_ADMIN capability. Events of threads are filtered out.
+ *
+ * @return A non-blocking descriptor delivering the events,
+ *         or -1 if process events are not available.
+ */
+int open_process_events(void);
+
+/**
+ * Reads the pending process events without blocking.
+ *
+ * @param fd Descriptor returned by open_process_events().
+ * @param events Array to store the events.
+ * @param max Size of the events array.
+ * @return Number of events stored (0 if none is pending),
+ *         or -1 on error. errno is set to ENOBUFS if events were lost
+ *         because the receive queue overflowed.
+ */
+int read_process_events(int fd, struct process_event *events, int max);
+
+/**
+ * Waits until process events are pending or the timeout expires.
+ *
+ * @param fd Descriptor returned by open_process_events().
+ * @param timeout_ms Timeout in milliseconds.
+ * @return 1 if events are pending, 0 on timeout, -1 on error.
+ */
+int wait_process_events(int fd, int timeout_ms);
+
+/**
+ * Unsubscribes from process events and closes the descriptor.
+ *
+ * @param fd Descriptor returned by open_process_events().
+ */
+void close_process_events(int fd);
+
+#endif
@@ -30,8 +30,10 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <time.h>
+#include <poll.h>
 
 #include "process_iterator.h"
+#include "process_events.h"
 #include "process_group.h"
 #include "list.h"
 #include "process_table.h"
@@ -46,52 +48,117 @@ pid_t find_process_by_pid(pid_t pid)
     return (kill(pid, 0) == 0) ? pid : -pid;
 }
 
-/* look for a process with a given name
-process: the name of the wanted process. it can be an absolute path name to the executable file
-        or just the file name
-return:  pid of the found process, if it is found
-        0, if it's not found
-        negative pid, if it is found but it's not possible to control it */
-pid_t find_process_by_name(char *process_name)
+/* read the given fields of a single process, whose command is held by the
+   iterator: the caller must close it whenever the function returns 0 */
+static int read_one_process(struct process_iterator *it, struct process_filter *filter,
+                            pid_t pid, const struct process_table *known, int fields,
+                            struct process *p)
+{
+    filter->pid = pid;
+    filter->include_children = 0;
+    filter->known = known;
+    filter->fields = fields;
+    filter->name = NULL;
+    filter->cgroup_fd = -1;
+    if (init_process_iterator(it, filter) != 0)
+        return -1;
+    if (get_next_process(it, p) != 0)
+    {
+        close_process_iterator(it);
+        return -1;
+    }
+    return 0;
+}
+
+/* read the CPU times of a single process, leaving its command unset */
+static int read_process_times(pid_t pid, const struct process_table *known, struct process *p)
+{
+    struct process_iterator it;
+    struct process_filter filter;
+    if (read_one_process(&it, &filter, pid, known, PROCESS_FIELDS_STATUS, p) != 0)
+        return -1;
+    close_process_iterator(&it);
+    return 0;
+}
+
+pid_t find_process_by_matcher(struct process_matcher *matcher)
 {
     /* pid of the target process */
     pid_t pid = -1;
 
     /* process iterator */
     struct process_iterator it;
-    struct process *proc;
+    struct process proc;
     struct process_filter filter;
-    const char *process_basename = basename(process_name);
-    proc = (struct process *)malloc(sizeof(struct process));
-    if (proc == NULL)
-    {
-        fprintf(stderr, "Memory allocation failed for the process\n");
-        exit(EXIT_FAILURE);
-    }
 
     filter.pid = 0;
     filter.include_children = 0;
+    filter.known = NULL;
+    filter.fields = matcher->fields;
+    filter.name = matcher->hint;
+    filter.cgroup_fd = -1;
     init_process_iterator(&it, &filter);
-    while (get_next_process(&it, proc) != -1)
+    while (get_next_process(&it, &proc) != -1)
     {
         /* process found */
-        const char *cmd_basename = basename(proc->command);
-        if (strncmp(cmd_basename, process_basename, sizeof(proc->command)) == 0)
+        if (process_matcher_match(matcher, &proc))
         {
-            if (pid < 0 || is_child_of(pid, proc->pid))
+            if (pid < 0 || iterator_is_child_of(&it, pid, proc.pid))
             {
-                pid = proc->pid;
+                pid = proc.pid;
             }
         }
     }
-    free(proc);
     if (close_process_iterator(&it) != 0)
         exit(EXIT_FAILURE);
+    process_matcher_end_scan(matcher);
 
     return (pid > 0) ? find_process_by_pid(pid) : 0;
 }
 
-int init_process_group(struct process_group *pgroup, pid_t target_pid, int include_children)
+/* look for a process with a given name
+process: the name of the wanted process. it can be an absolute path name to the executable file
+        or just the file name
+return:  pid of the found process, if it is found
+        0, if it's not found
+        negative pid, if it is found but it's not possible to control it */
+pid_t find_process_by_name(char *process_name)
+{
+    struct process_matcher matcher;
+    pid_t pid;
+    process_matcher_init(&matcher, MATCH_NAME, process_name);
+    pid = find_process_by_matcher(&matcher);
+    process_matcher_destroy(&matcher);
+    return pid;
+}
+
+int process_matches(pid_t pid, struct process_matcher *matcher)
+{
+    struct process_iterator it;
+    struct process_filter filter;
+    struct process proc;
+    int ret;
+    if (read_one_process(&it, &filter, pid, NULL, matcher->fields, &proc) != 0)
+        return 0;
+    /* the process may have executed another program since it was cached */
+    process_matcher_forget(matcher, pid);
+    ret = process_matcher_match(matcher, &proc);
+    close_process_iterator(&it);
+    return ret;
+}
+
+int process_has_name(pid_t pid, char *process_name)
+{
+    struct process_matcher matcher;
+    int ret;
+    process_matcher_init(&matcher, MATCH_NAME, process_name);
+    ret = process_matches(pid, &matcher);
+    process_matcher_destroy(&matcher);
+    return ret;
+}
+
+/* initialize the group without looking for its members */
+static void setup_process_group(struct process_group *pgroup, pid_t target_pid, int include_children)
 {
     /* hashtable initialization */
     pgroup->proctable = (struct process_table *)malloc(sizeof(struct process_table));
@@ -110,10 +177,60 @@ int init_process_group(struct process_group *pgroup, pid_t target_pid, int inclu
         exit(EXIT_FAILURE);
     }
     init_list(pgroup->proclist, sizeof(pid_t));
+    init_list(&pgroup->spare_processes, sizeof(pid_t));
+    string_pool_init(&pgroup->commands);
+    pgroup->hot.count = 0;
+    pgroup->hot.capacity = 0;
+    pgroup->hot.pid = NULL;
+    pgroup->hot.cpu_usage = NULL;
+    pgroup->hot.node = NULL;
+    pgroup->joined.count = pgroup->joined.capacity = 0;
+    pgroup->joined.pid = NULL;
+    pgroup->left.count = pgroup->left.capacity = 0;
+    pgroup->left.pid = NULL;
+    pgroup->scan_iterator_open = 0;
+    /* the control loop never looks at the commands of the members */
+    pgroup->scan_filter.fields = PROCESS_FIELDS_STATUS;
+    pgroup->scan_filter.name = NULL;
+    pgroup->scan_filter.cgroup_fd = -1;
+    pgroup->pollfds = NULL;
+    pgroup->pollfds_capacity = 0;
+    pgroup->updates = 0;
+    pgroup->events_fd = -1;
+    pgroup->resync = 0;
+    usage_estimator_init(&pgroup->estimator, ESTIMATOR_EWMA, ESTIMATOR_DEFAULT_TAU);
+    pgroup->scan_time = 0;
+    pgroup->matcher = NULL;
     if (get_time(&pgroup->last_update))
     {
         exit(EXIT_FAILURE);
     }
+}
+
+int init_process_group(struct process_group *pgroup, pid_t target_pid, int include_children)
+{
+    setup_process_group(pgroup, target_pid, include_children);
+    update_process_group(pgroup);
+    return 0;
+}
+
+int init_process_group_matching(struct process_group *pgroup, struct process_matcher *matcher,
+                                int include_children)
+{
+    setup_process_group(pgroup, 0, include_children);
+    pgroup->matcher = matcher;
+    pgroup->scan_filter.fields = matcher->fields;
+    /* the descendants of the instances may have any name */
+    pgroup->scan_filter.name = include_children ? NULL : matcher->hint;
+    update_process_group(pgroup);
+    return 0;
+}
+
+int init_process_group_cgroup(struct process_group *pgroup, int cgroup_fd)
+{
+    /* the children of the members are created in their cgroup */
+    setup_process_group(pgroup, 0, 1);
+    pgroup->scan_filter.cgroup_fd = cgroup_fd;
     update_process_group(pgroup);
     return 0;
 }
@@ -122,6 +239,11 @@ int close_process_group(struct process_group *pgroup)
 {
     if (pgroup->proclist != NULL)
     {
+        struct list_node *node;
+        for (node = pgroup->proclist->first; node != NULL; node = node->next)
+        {
+            close_process_handles((struct process *)node->data);
+        }
         clear_list(pgroup->proclist);
         free(pgroup->proclist);
         pgroup->proclist = NULL;
@@ -134,13 +256,42 @@ int close_process_group(struct process_group *pgroup)
         pgroup->proctable = NULL;
     }
 
+    if (pgroup->scan_iterator_open)
+    {
+        close_process_iterator(&pgroup->scan_iterator);
+        pgroup->scan_iterator_open = 0;
+    }
+    destroy_list(&pgroup->spare_processes);
+    free(pgroup->pollfds);
+    pgroup->pollfds = NULL;
+    pgroup->pollfds_capacity = 0;
+    string_pool_destroy(&pgroup->commands);
+    free(pgroup->hot.pid);
+    free(pgroup->hot.cpu_usage);
+    free(pgroup->hot.node);
+    pgroup->hot.pid = NULL;
+    pgroup->hot.cpu_usage = NULL;
+    pgroup->hot.node = NULL;
+    pgroup->hot.count = pgroup->hot.capacity = 0;
+    free(pgroup->joined.pid);
+    free(pgroup->left.pid);
+    pgroup->joined.pid = pgroup->left.pid = NULL;
+    pgroup->joined.count = pgroup->joined.capacity = 0;
+    pgroup->left.count = pgroup->left.capacity = 0;
+
     return 0;
 }
 
-static struct process *process_dup(const struct process *proc)
+/* copy a process into a record of the group, reusing the record of a former member if any */
+static struct process *process_dup(struct process_group *pgroup, const struct process *proc)
 {
-    struct process *p = (struct process *)malloc(sizeof(struct process));
-    if (p == NULL)
+    struct process *p;
+    if (!is_empty_list(&pgroup->spare_processes))
+    {
+        p = (struct process *)first_elem(&pgroup->spare_processes);
+        delete_node(&pgroup->spare_processes, first_node(&pgroup->spare_processes));
+    }
+    else if ((p = (struct process *)malloc(sizeof(struct process))) == NULL)
     {
         fprintf(stderr, "Memory allocation failed for duplicated process\n");
         exit(EXIT_FAILURE);
@@ -148,76 +299,523 @@ static struct process *process_dup(const struct process *proc)
     return (struct process *)memcpy(p, proc, sizeof(struct process));
 }
 
-/* parameter in range 0-1 */
-#define ALPHA 0.08
-#define MIN_DT 20
+/* append a PID to a vector */
+static void push_pid(struct pid_vector *v, pid_t pid)
+{
+    if (v->count == v->capacity)
+    {
+        v->capacity = v->capacity > 0 ? v->capacity * 2 : 16;
+        v->pid = (pid_t *)realloc(v->pid, (size_t)v->capacity * sizeof(pid_t));
+        if (v->pid == NULL)
+        {
+            fprintf(stderr, "Memory allocation failed for the PID vector\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    v->pid[v->count++] = pid;
+}
 
-void update_process_group(struct process_group *pgroup)
+/* return the index of pid in the member vectors, or the index where it would be inserted */
+static int member_slot(const struct process_vectors *v, pid_t pid)
 {
-    struct process_iterator it;
-    struct process *tmp_process, *p;
-    struct process_filter filter;
-    struct timespec now;
-    double dt;
-    if (get_time(&now))
+    int lo = 0, hi = v->count;
+    while (lo < hi)
     {
-        exit(EXIT_FAILURE);
+        int mid = lo + (hi - lo) / 2;
+        if (v->pid[mid] < pid)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
-    tmp_process = (struct process *)malloc(sizeof(struct process));
-    if (tmp_process == NULL)
+    return lo;
+}
+
+/* return the index of pid in the member vectors, or -1 if it is not a member */
+static int find_member(const struct process_vectors *v, pid_t pid)
+{
+    int i = member_slot(v, pid);
+    return (i < v->count && v->pid[i] == pid) ? i : -1;
+}
+
+/* insert a new member at its place in the member vectors */
+static void insert_member(struct process_vectors *v, struct list_node *node)
+{
+    pid_t pid = ((const struct process *)node->data)->pid;
+    int i = member_slot(v, pid);
+    if (v->count == v->capacity)
     {
-        fprintf(stderr, "Memory allocation failed for tmp_process\n");
-        exit(EXIT_FAILURE);
+        v->capacity = v->capacity > 0 ? v->capacity * 2 : 64;
+        v->pid = (pid_t *)realloc(v->pid, (size_t)v->capacity * sizeof(pid_t));
+        v->cpu_usage = (double *)realloc(v->cpu_usage, (size_t)v->capacity * sizeof(double));
+        v->node = (struct list_node **)realloc(v->node, (size_t)v->capacity * sizeof(struct list_node *));
+        if (v->pid == NULL || v->cpu_usage == NULL || v->node == NULL)
+        {
+            fprintf(stderr, "Memory allocation failed for the process vectors\n");
+            exit(EXIT_FAILURE);
+        }
     }
-    /* time elapsed from previous sample (in ms) */
-    dt = timediff_in_ms(&now, &pgroup->last_update);
-    filter.pid = pgroup->target_pid;
-    filter.include_children = pgroup->include_children;
-    init_process_iterator(&it, &filter);
-    clear_list(pgroup->proclist);
-    init_list(pgroup->proclist, sizeof(pid_t));
+    memmove(&v->pid[i + 1], &v->pid[i], (size_t)(v->count - i) * sizeof(pid_t));
+    memmove(&v->cpu_usage[i + 1], &v->cpu_usage[i], (size_t)(v->count - i) * sizeof(double));
+    memmove(&v->node[i + 1], &v->node[i], (size_t)(v->count - i) * sizeof(struct list_node *));
+    v->pid[i] = pid;
+    v->cpu_usage[i] = -1;
+    v->node[i] = node;
+    v->count++;
+}
+
+/* remove the member at index i from the member vectors */
+static void erase_member(struct process_vectors *v, int i)
+{
+    v->count--;
+    memmove(&v->pid[i], &v->pid[i + 1], (size_t)(v->count - i) * sizeof(pid_t));
+    memmove(&v->cpu_usage[i], &v->cpu_usage[i + 1], (size_t)(v->count - i) * sizeof(double));
+    memmove(&v->node[i], &v->node[i + 1], (size_t)(v->count - i) * sizeof(struct list_node *));
+}
+
+/* interval between two scans of /proc when events are used (in ms) */
+#define RESYNC_INTERVAL 10000
+
+/* maximum number of process events read at once */
+#define MAX_EVENTS 256
+
+/* update the CPU usage of a process from a new sample of its CPU times */
+static void update_cpu_usage(const struct process_group *pgroup, struct process *p,
+                             const struct process *sample_proc, double dt)
+{
+    /* CPU time of all the threads, up to dt per thread for a multithreaded process */
+    double cputime = sample_proc->cputime - p->cputime;
+    /* CPU time of the children waited for since the previous sample */
+    double reaped = MAX(sample_proc->children_cputime - p->children_cputime, 0.0);
+    /* part of it already accounted while the children were tracked */
+    double credit = MIN(reaped, p->reaped_cputime);
+    cputime += reaped - credit;
+    p->reaped_cputime -= credit;
+    p->cpu_usage = usage_estimator_update(&pgroup->estimator, &p->usage, p->cpu_usage, cputime, dt);
+    p->cputime = sample_proc->cputime;
+    p->children_cputime = sample_proc->children_cputime;
+}
 
-    while (get_next_process(&it, tmp_process) != -1)
+/* the CPU time accounted for a member leaving the group shows up again in the
+   children CPU time of its parent once waited for, so credit it to the parent */
+static void credit_parent(struct process_group *pgroup, const struct process *p)
+{
+    struct process *parent = process_table_find_pid(pgroup->proctable, p->ppid);
+    if (parent != NULL && parent->seen == pgroup->updates)
+        parent->reaped_cputime += p->cputime + p->children_cputime - p->base_cputime;
+}
+
+/* start tracking a process as a member of the group, whose previous information may be stale */
+static struct process *track_process(struct process_group *pgroup, struct process *proc)
+{
+    struct process *p = process_table_find(pgroup->proctable, proc);
+    proc->cpu_usage = -1;
+    usage_estimate_init(&proc->usage);
+    /* the command held by the iterator must outlive it */
+    if (proc->command != NULL)
+        proc->command = string_pool_intern(&pgroup->commands, proc->command);
+    if (p == NULL)
     {
-        p = process_table_find(pgroup->proctable, tmp_process);
-        if (p == NULL)
+        p = process_dup(pgroup, proc);
+        process_table_add(pgroup->proctable, p);
+        insert_member(&pgroup->hot, add_elem(pgroup->proclist, p));
+    }
+    else
+    {
+        /* the pid has been reused by another process */
+        credit_parent(pgroup, p);
+        close_process_handles(p);
+        string_pool_release(&pgroup->commands, p->command);
+        memcpy(p, proc, sizeof(struct process));
+        pgroup->hot.cpu_usage[member_slot(&pgroup->hot, p->pid)] = -1;
+        push_pid(&pgroup->left, p->pid);
+    }
+    open_process_handles(p);
+    p->base_cputime = p->cputime + p->children_cputime;
+    p->reaped_cputime = 0;
+    p->seen = pgroup->updates;
+    push_pid(&pgroup->joined, p->pid);
+    return p;
+}
+
+/* stop tracking a process which has left the group, and free it */
+static void forget_process(struct process_group *pgroup, struct process *p)
+{
+    credit_parent(pgroup, p);
+    close_process_handles(p);
+    string_pool_release(&pgroup->commands, p->command);
+    process_table_del(pgroup->proctable, p);
+    add_elem(&pgroup->spare_processes, p);
+}
+
+/* stop tracking a member of the group, whose entry in the member vectors is dropped by the caller */
+static void drop_member(struct process_group *pgroup, struct list_node *node)
+{
+    struct process *p = (struct process *)node->data;
+    push_pid(&pgroup->left, p->pid);
+    delete_node(pgroup->proclist, node);
+    forget_process(pgroup, p);
+}
+
+/* stop tracking the member at index i of the member vectors */
+static void remove_member(struct process_group *pgroup, int i)
+{
+    struct list_node *node = pgroup->hot.node[i];
+    erase_member(&pgroup->hot, i);
+    drop_member(pgroup, node);
+}
+
+/* stop tracking the members not seen by the current generation of the group,
+   compacting the member vectors in one pass */
+static void sweep_members(struct process_group *pgroup)
+{
+    struct process_vectors *v = &pgroup->hot;
+    int i, j;
+    for (i = j = 0; i < v->count; i++)
+    {
+        if (((const struct process *)v->node[i]->data)->seen != pgroup->updates)
         {
-            /* process is new. add it */
-            tmp_process->cpu_usage = -1;
-            p = process_dup(tmp_process);
-            process_table_add(pgroup->proctable, p);
-            add_elem(pgroup->proclist, p);
+            drop_member(pgroup, v->node[i]);
+            continue;
         }
-        else
+        v->pid[j] = v->pid[i];
+        v->cpu_usage[j] = v->cpu_usage[i];
+        v->node[j] = v->node[i];
+        j++;
+    }
+    v->count = j;
+}
+
+void process_group_use_events(struct process_group *pgroup, int events_fd)
+{
+    /* a single process is sampled without scanning /proc anyway */
+    if (pgroup->include_children || pgroup->matcher != NULL)
+        pgroup->events_fd = events_fd;
+    /* the events report the instances executing another program */
+    if (pgroup->matcher != NULL)
+        process_matcher_use_events(pgroup->matcher);
+}
+
+/* tell whether a process which is not a member yet joins the group: in a group
+   selecting its members by pattern, the instances and (if children are
+   included) the processes whose parent is a member, in a cgroup, any
+   process but the limiter */
+static int process_joins(const struct process_group *pgroup, const struct process *p)
+{
+    const struct process *parent;
+    /* a limiter running in the limited cgroup must not stop itself */
+    if (pgroup->scan_filter.cgroup_fd >= 0)
+        return p->pid != getpid();
+    if (pgroup->matcher == NULL)
+        return 1;
+    if (process_matcher_match(pgroup->matcher, p))
+        /* a limiter matching its own pattern must not stop itself */
+        return p->pid != getpid();
+    if (!pgroup->include_children)
+        return 0;
+    parent = process_table_find_pid(pgroup->proctable, p->ppid);
+    /* the parent is a member already seen by this update, or not seen yet */
+    return parent != NULL && parent->starttime <= p->starttime &&
+           (parent->seen == pgroup->updates || parent->seen + 1 == pgroup->updates);
+}
+
+/* apply the pending process events, adding the new members to joined if not NULL */
+static int apply_events(struct process_group *pgroup, struct list *joined)
+{
+    struct process_event events[MAX_EVENTS];
+    struct process tmp_process, *p;
+    int i, n, count = 0;
+    if (pgroup->events_fd < 0 || pgroup->resync)
+        return -1;
+
+    while ((n = read_process_events(pgroup->events_fd, events, MAX_EVENTS)) > 0)
+    {
+        for (i = 0; i < n; i++)
         {
-            double sample;
-            add_elem(pgroup->proclist, p);
-            if (dt < MIN_DT)
-                continue;
-            /* process exists. update CPU usage */
-            sample = (tmp_process->cputime - p->cputime) / dt;
-            sample = MIN(sample, 1.0);
-            if (p->cpu_usage < 0)
+            const struct process_event *ev = &events[i];
+            if (ev->type == PROCESS_EVENT_FORK)
             {
-                /* initialization */
-                p->cpu_usage = sample;
+                const struct process *parent = process_table_find_pid(pgroup->proctable, ev->ppid);
+                struct process_iterator it;
+                struct process_filter filter;
+                if (parent == NULL || parent->seen != pgroup->updates)
+                    continue;
+                /* a fork queued before the first scan, which has already found the child */
+                if (find_member(&pgroup->hot, ev->pid) >= 0)
+                    continue;
+                /* the child may have already exited */
+                if (read_one_process(&it, &filter, ev->pid, NULL, pgroup->scan_filter.fields,
+                                     &tmp_process) != 0)
+                    continue;
+                if (!process_joins(pgroup, &tmp_process))
+                {
+                    close_process_iterator(&it);
+                    continue;
+                }
+                p = track_process(pgroup, &tmp_process);
+                close_process_iterator(&it);
+                if (joined != NULL)
+                    add_elem(joined, p);
+                count++;
             }
-            else
+            else if (ev->type == PROCESS_EVENT_EXEC && pgroup->matcher != NULL)
             {
-                /* usage adjustment */
-                p->cpu_usage = (1.0 - ALPHA) * p->cpu_usage + ALPHA * sample;
+                struct process_iterator it;
+                struct process_filter filter;
+                int member = find_member(&pgroup->hot, ev->pid);
+                process_matcher_forget(pgroup->matcher, ev->pid);
+                /* the members with their children stay, whatever they execute */
+                if (member >= 0 && pgroup->include_children)
+                    continue;
+                if (read_one_process(&it, &filter, ev->pid, NULL, pgroup->scan_filter.fields,
+                                     &tmp_process) != 0)
+                    continue;
+                if (!process_matcher_match(pgroup->matcher, &tmp_process))
+                {
+                    /* an instance executing another program leaves the group */
+                    if (member >= 0)
+                        remove_member(pgroup, member);
+                }
+                else if (member < 0)
+                {
+                    p = track_process(pgroup, &tmp_process);
+                    if (joined != NULL)
+                        add_elem(joined, p);
+                    count++;
+                }
+                close_process_iterator(&it);
+            }
+            else if (ev->type == PROCESS_EVENT_EXIT)
+            {
+                int member = find_member(&pgroup->hot, ev->pid);
+                if (member < 0)
+                    continue;
+                remove_member(pgroup, member);
+                if (ev->pid == pgroup->target_pid)
+                {
+                    /* the descendants of the target are no longer part of the group */
+                    pgroup->resync = 1;
+                }
             }
-            p->cputime = tmp_process->cputime;
         }
+        if (n < MAX_EVENTS)
+            break;
     }
-    free(tmp_process);
-    close_process_iterator(&it);
-    if (dt < MIN_DT)
+    if (n < 0)
+    {
+        /* events have been lost, the executed programs as well */
+        pgroup->resync = 1;
+        if (pgroup->matcher != NULL)
+            process_matcher_forget_all(pgroup->matcher);
+    }
+    return pgroup->resync ? -1 : count;
+}
+
+void process_group_use_estimator(struct process_group *pgroup, const struct usage_estimator *estimator)
+{
+    pgroup->estimator = *estimator;
+}
+
+int process_group_apply_events(struct process_group *pgroup)
+{
+    return apply_events(pgroup, NULL);
+}
+
+/* remove the members whose process file descriptor reports their exit */
+static void remove_exited_members(struct process_group *pgroup)
+{
+    struct process_vectors *v = &pgroup->hot;
+    struct pollfd *fds;
+    int i, n = 0;
+    for (i = 0; i < v->count; i++)
+    {
+        if (((const struct process *)v->node[i]->data)->pidfd >= 0)
+            n++;
+    }
+    if (n == 0)
+        return;
+    if (v->count > pgroup->pollfds_capacity)
+    {
+        int capacity = MAX(pgroup->pollfds_capacity * 2, v->count);
+        free(pgroup->pollfds);
+        pgroup->pollfds = (struct pollfd *)malloc((size_t)capacity * sizeof(struct pollfd));
+        if (pgroup->pollfds == NULL)
+        {
+            fprintf(stderr, "Memory allocation failed for the poll descriptors\n");
+            exit(EXIT_FAILURE);
+        }
+        pgroup->pollfds_capacity = capacity;
+    }
+    fds = pgroup->pollfds;
+    for (i = 0; i < v->count; i++)
+    {
+        /* negative descriptors are ignored by poll() */
+        fds[i].fd = ((const struct process *)v->node[i]->data)->pidfd;
+        fds[i].events = POLLIN;
+        fds[i].revents = 0;
+    }
+    syscall_count++;
+    if (poll(fds, (nfds_t)v->count, 0) > 0)
+    {
+        for (i = 0; i < v->count; i++)
+        {
+            /* leave the exited members out of the current generation */
+            if (fds[i].revents != 0)
+                ((struct process *)v->node[i]->data)->seen = pgroup->updates - 1;
+        }
+        sweep_members(pgroup);
+    }
+}
+
+/* refresh the membership of the group by scanning /proc, adding the new members to joined if not NULL */
+static void scan_process_group(struct process_group *pgroup, double dt, struct list *joined)
+{
+    struct process_iterator *it = &pgroup->scan_iterator;
+    struct process_vectors *v = &pgroup->hot;
+    struct process tmp_process, *p;
+    struct timespec start, end;
+    unsigned long previous;
+    pid_t last_pid = 0;
+    int i = 0;
+    if (get_time(&start))
+    {
+        exit(EXIT_FAILURE);
+    }
+    /* the members known to have exited are not read again */
+    remove_exited_members(pgroup);
+    pgroup->scan_filter.pid = pgroup->target_pid;
+    pgroup->scan_filter.include_children = pgroup->include_children;
+    pgroup->scan_filter.known = pgroup->proctable;
+    if (pgroup->scan_iterator_open)
+        pgroup->scan_iterator_open = reinit_process_iterator(it, &pgroup->scan_filter) == 0;
+    else
+        pgroup->scan_iterator_open = init_process_iterator(it, &pgroup->scan_filter) == 0;
+    previous = pgroup->updates++;
+
+    /* merge the processes found, in increasing PID order on Linux, with the member vectors */
+    while (pgroup->scan_iterator_open && get_next_process(it, &tmp_process) != -1)
+    {
+        if (tmp_process.pid > last_pid)
+        {
+            while (i < v->count && v->pid[i] < tmp_process.pid)
+                i++;
+        }
+        else
+        {
+            i = member_slot(v, tmp_process.pid);
+        }
+        last_pid = tmp_process.pid;
+        p = (i < v->count && v->pid[i] == tmp_process.pid) ? (struct process *)v->node[i]->data : NULL;
+        if (p == NULL || p->seen != previous || p->starttime != tmp_process.starttime)
+        {
+            if (!process_joins(pgroup, &tmp_process))
+                continue;
+            /* process is new. add it at index i */
+            p = track_process(pgroup, &tmp_process);
+            if (joined != NULL)
+                add_elem(joined, p);
+        }
+        else
+        {
+            if (p->stat_fd < 0)
+                open_process_handles(p);
+            p->seen = pgroup->updates;
+            if (dt <= 0)
+                continue;
+            /* process exists. update CPU usage */
+            update_cpu_usage(pgroup, p, &tmp_process, dt);
+            v->cpu_usage[i] = p->cpu_usage;
+        }
+    }
+
+    /* the members not found by the scan have left the group */
+    sweep_members(pgroup);
+    if (pgroup->matcher != NULL && pgroup->scan_iterator_open)
+        process_matcher_end_scan(pgroup->matcher);
+    if (get_time(&end))
+    {
+        exit(EXIT_FAILURE);
+    }
+    pgroup->scan_time = timediff_in_ms(&end, &start);
+}
+
+/* sample the members of the group, whose membership is kept by events */
+static void sample_process_group(struct process_group *pgroup, double dt)
+{
+    struct process_vectors *v = &pgroup->hot;
+    struct process tmp_process;
+    int i, gone = 0;
+    remove_exited_members(pgroup);
+    for (i = 0; i < v->count; i++)
+    {
+        struct process *p = (struct process *)v->node[i]->data;
+        if (read_process_times(p->pid, pgroup->proctable, &tmp_process) != 0 ||
+            tmp_process.starttime != p->starttime)
+        {
+            /* the process is gone, its exit event is still pending */
+            p->seen = pgroup->updates - 1;
+            gone = 1;
+            continue;
+        }
+        if (dt > 0)
+        {
+            update_cpu_usage(pgroup, p, &tmp_process, dt);
+            v->cpu_usage[i] = p->cpu_usage;
+        }
+    }
+    if (gone)
+        sweep_members(pgroup);
+}
+
+void update_process_group(struct process_group *pgroup)
+{
+    struct timespec now;
+    double dt;
+    if (get_time(&now))
+    {
+        exit(EXIT_FAILURE);
+    }
+    /* time elapsed from previous sample (in ms) */
+    dt = timediff_in_ms(&now, &pgroup->last_update);
+    pgroup->joined.count = 0;
+    pgroup->left.count = 0;
+
+    if (process_group_apply_events(pgroup) >= 0 &&
+        timediff_in_ms(&now, &pgroup->last_scan) < RESYNC_INTERVAL)
+    {
+        sample_process_group(pgroup, dt);
+    }
+    else
+    {
+        scan_process_group(pgroup, dt, NULL);
+        pgroup->resync = 0;
+        pgroup->last_scan = now;
+    }
+
+    if (dt <= 0)
         return;
     pgroup->last_update = now;
 }
 
+int refresh_process_group(struct process_group *pgroup, struct list *joined)
+{
+    int count = joined->count;
+    if (apply_events(pgroup, joined) < 0)
+    {
+        scan_process_group(pgroup, 0, joined);
+        pgroup->resync = 0;
+        if (get_time(&pgroup->last_scan))
+        {
+            exit(EXIT_FAILURE);
+        }
+    }
+    return joined->count - count;
+}
+
 int remove_process(struct process_group *pgroup, pid_t pid)
 {
-    return process_table_del_pid(pgroup->proctable, pid);
+    int member = find_member(&pgroup->hot, pid);
+    if (member < 0)
+        return 1;
+    remove_member(pgroup, member);
+    return 0;
 }
@@ -27,9 +27,50 @@
 #endif
 
 #include <time.h>
+#include <poll.h>
 
 #include "process_iterator.h"
 #include "list.h"
+#include "process_matcher.h"
+#include "string_pool.h"
+
+/**
+ * Structure holding the fields of the members of a process group used at
+ * every control cycle as dense vectors sorted by PID, so that they are
+ * scanned linearly and merged with the processes found by a scan.
+ */
+struct process_vectors
+{
+    /* Number of members in the vectors */
+    int count;
+
+    /* Allocated capacity of the vectors */
+    int capacity;
+
+    /* PID of each member, in increasing order */
+    pid_t *pid;
+
+    /* CPU usage estimation of each member (-1 if not known yet) */
+    double *cpu_usage;
+
+    /* Node of each member in the list of the group */
+    struct list_node **node;
+};
+
+/**
+ * Structure representing a growable vector of PIDs.
+ */
+struct pid_vector
+{
+    /* Number of PIDs in the vector */
+    int count;
+
+    /* Allocated capacity of the vector */
+    int capacity;
+
+    /* PIDs stored in the vector */
+    pid_t *pid;
+};
 
 /**
  * Structure representing a group of processes for tracking.
@@ -50,6 +91,58 @@ struct process_group
 
     /* Timestamp of the last update for this process group */
     struct timespec last_update;
+
+    /* Number of updates of this process group */
+    unsigned long updates;
+
+    /* Descriptor delivering process events (not owned), or -1 to scan /proc */
+    int events_fd;
+
+    /* Flag indicating whether the next update must scan /proc again */
+    int resync;
+
+    /* Timestamp of the last scan of /proc for this process group */
+    struct timespec last_scan;
+
+    /* Duration of the last scan of /proc (in ms) */
+    double scan_time;
+
+    /* Estimation of the CPU usage of the members */
+    struct usage_estimator estimator;
+
+    /* Control fields of the members, kept in sync with the list */
+    struct process_vectors hot;
+
+    /* Processes which joined the group since the beginning of the last update */
+    struct pid_vector joined;
+
+    /* Processes which left the group since the beginning of the last update */
+    struct pid_vector left;
+
+    /* Commands of the members, each distinct command stored once.
+       The commands are only read if the scan filter asks for them */
+    struct string_pool commands;
+
+    /* Records of the processes which left the group, kept for reuse */
+    struct list spare_processes;
+
+    /* Iterator scanning the processes, kept to reuse its memory */
+    struct process_iterator scan_iterator;
+
+    /* Filter of the scan iterator */
+    struct process_filter scan_filter;
+
+    /* Flag indicating whether the scan iterator is initialized */
+    int scan_iterator_open;
+
+    /* Pattern selecting the members (not owned), or NULL to follow target_pid */
+    struct process_matcher *matcher;
+
+    /* Descriptors polled to detect the exit of the members */
+    struct pollfd *pollfds;
+
+    /* Allocated capacity of the pollfds array */
+    int pollfds_capacity;
 };
 
 /**
@@ -62,13 +155,83 @@ struct process_group
  */
 int init_process_group(struct process_group *pgroup, pid_t target_pid, int include_children);
 
+/**
+ * Initialize a process group whose members are all the processes matching
+ * a pattern, and their descendants if children are included. Every scan
+ * of /proc looks for the new instances and drops the exited ones.
+ *
+ * @param pgroup Pointer to the process group structure to initialize.
+ * @param matcher Pattern of the members, which must outlive the group.
+ * @param include_children Flag indicating whether to include child processes.
+ * @return 0 on success, exits with -1 on memory allocation failure.
+ */
+int init_process_group_matching(struct process_group *pgroup, struct process_matcher *matcher,
+                                int include_children);
+
+/**
+ * Initialize a process group whose members are the processes of a cgroup v2
+ * and of its descendant cgroups. The processes moved into the cgroup join
+ * the group at the next scan of the cgroup, their children as soon as they
+ * are created if process events are used.
+ *
+ * @param pgroup Pointer to the process group structure to initialize.
+ * @param cgroup_fd Descriptor of the cgroup directory, which must stay open
+ *                  while the group uses it.
+ * @return 0 on success, exits with -1 on memory allocation failure.
+ */
+int init_process_group_cgroup(struct process_group *pgroup, int cgroup_fd);
+
 /**
  * Update the process group with the latest process information.
+ * The joined and left vectors of the group are emptied first, then
+ * record the membership changes until the next update.
  *
  * @param pgroup Pointer to the process group to update.
  */
 void update_process_group(struct process_group *pgroup);
 
+/**
+ * Look for the processes which joined the process group since the last
+ * update, without sampling the CPU usage of the members.
+ *
+ * @param pgroup Pointer to the process group.
+ * @param joined List to which the processes which joined the group are added.
+ * @return Number of processes which joined the group.
+ */
+int refresh_process_group(struct process_group *pgroup, struct list *joined);
+
+/**
+ * Track the membership of the process group through process events
+ * instead of scanning /proc at every update. /proc is still scanned
+ * periodically, and whenever events have been lost, to resynchronize.
+ * Events are only used when children are included or the members are
+ * selected by a pattern.
+ *
+ * @param pgroup Pointer to the process group.
+ * @param events_fd Descriptor returned by open_process_events(),
+ *                  which must stay open while the group uses it.
+ */
+void process_group_use_events(struct process_group *pgroup, int events_fd);
+
+/**
+ * Set how the CPU usage of the members is estimated from the next update on.
+ * The group uses a moving average with the default time constant until then.
+ *
+ * @param pgroup Pointer to the process group.
+ * @param estimator Configuration of the estimator, copied by the group.
+ */
+void process_group_use_estimator(struct process_group *pgroup, const struct usage_estimator *estimator);
+
+/**
+ * Apply the pending process events to the membership of the process
+ * group, without sampling the CPU usage of its members.
+ *
+ * @param pgroup Pointer to the process group.
+ * @return Number of processes which joined the group,
+ *         or -1 if the group does not use events or must scan /proc again.
+ */
+int process_group_apply_events(struct process_group *pgroup);
+
 /**
  * Close a process group and free associated resources.
  *
@@ -86,6 +249,17 @@ int close_process_group(struct process_group *pgroup);
  */
 pid_t find_process_by_pid(pid_t pid);
 
+/**
+ * Look for a process matching a pattern. Among the matching processes,
+ * the one which is an ancestor of the others is preferred.
+ *
+ * @param matcher The compiled pattern, whose cache is updated by the scan.
+ * @return PID of the found process if it is found,
+ *         0 if the process is not found,
+ *         Negative PID if the process is found but cannot be controlled.
+ */
+pid_t find_process_by_matcher(struct process_matcher *matcher);
+
 /**
  * Look for a process with a given name.
  *
@@ -97,6 +271,24 @@ pid_t find_process_by_pid(pid_t pid);
  */
 pid_t find_process_by_name(char *process_name);
 
+/**
+ * Check whether a process runs a given executable.
+ *
+ * @param pid The PID of the process.
+ * @param process_name The name of the executable, as for find_process_by_name().
+ * @return 1 if the process runs the executable, 0 otherwise.
+ */
+int process_has_name(pid_t pid, char *process_name);
+
+/**
+ * Check whether a process matches a pattern, ignoring its cached result.
+ *
+ * @param pid The PID of the process.
+ * @param matcher The compiled pattern.
+ * @return 1 if the process matches, 0 otherwise.
+ */
+int process_matches(pid_t pid, struct process_matcher *matcher);
+
 /**
  * Remove a process from the process group by its PID.
  *
@@ -27,10 +27,13 @@
 #endif
 
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <limits.h>
-#ifdef __linux__
-#include <dirent.h>
-#endif
+#include <stdint.h>
+
+#include "estimator.h"
+
+struct process_table;
 #ifdef __FreeBSD__
 #include <kvm.h>
 #endif
@@ -46,16 +49,75 @@ struct process
     /* Parent Process ID of the process */
     pid_t ppid;
 
+    /* Start time of the process (in platform-specific units), telling apart processes with the same PID */
+    int64_t starttime;
+
     /* CPU time used by the process (in milliseconds) */
     double cputime;
 
-    /* Actual CPU usage estimation (value in range 0-1) */
+    /* CPU time used by the waited-for children of the process (in milliseconds) */
+    double children_cputime;
+
+    /* CPU time of the process and its waited-for children when it joined its group (in ms) */
+    double base_cputime;
+
+    /* CPU time of tracked children already accounted for but not yet waited for (in ms) */
+    double reaped_cputime;
+
+    /* Actual CPU usage estimation (in CPUs, up to one per thread) */
     double cpu_usage;
 
-    /* Absolute path of the executable file */
-    char command[PATH_MAX];
+    /* State of the estimation of the CPU usage */
+    struct usage_estimate usage;
+
+    /* Descriptor kept open to sample the process while it is tracked, or -1 */
+    int stat_fd;
+
+    /* Process file descriptor referring to the process while it is tracked, or -1 */
+    int pidfd;
+
+    /* Number of descriptors opened by open_process_handles() and not closed
+       by close_process_handles() yet */
+    int handles;
+
+    /* Sequence number of the last process group update that saw the process */
+    unsigned long seen;
+
+    /* Command of the process: the first argument of its command line with
+       PROCESS_FIELD_COMMAND, the path of its executable file with
+       PROCESS_FIELD_EXE, NULL if neither field was requested. It points to
+       storage of the iterator which returned the process, valid until the
+       next call to get_next_process() or close_process_iterator(), or to a
+       string interned by the process group for its members */
+    const char *command;
 };
 
+/**
+ * Structure representing the CPU time used by a thread of a process.
+ */
+struct thread_cputime
+{
+    /* Thread ID */
+    pid_t tid;
+
+    /* CPU time used by the thread (in milliseconds) */
+    double cputime;
+};
+
+/* Fields of a process which can be requested from an iterator */
+#define PROCESS_FIELD_PID 0x01
+#define PROCESS_FIELD_PPID 0x02
+#define PROCESS_FIELD_CPUTIME 0x04
+#define PROCESS_FIELD_STARTTIME 0x08
+/* command is the first argument of the command line */
+#define PROCESS_FIELD_COMMAND 0x10
+/* command is the executable file, taking precedence over PROCESS_FIELD_COMMAND */
+#define PROCESS_FIELD_EXE 0x20
+
+/* Fields read from the status of the process, without reading its command */
+#define PROCESS_FIELDS_STATUS \
+    (PROCESS_FIELD_PID | PROCESS_FIELD_PPID | PROCESS_FIELD_CPUTIME | PROCESS_FIELD_STARTTIME)
+
 /**
  * Structure representing a filter for processes.
  */
@@ -66,8 +128,145 @@ struct process_filter
 
     /* Flag indicating whether to include child processes (1 for yes, 0 for no) */
     int include_children;
+
+    /* Table of tracked processes whose open descriptors can be reused, or NULL */
+    const struct process_table *known;
+
+    /* Mask of PROCESS_FIELD_* values telling the fields the caller needs.
+       Without PROCESS_FIELD_COMMAND or PROCESS_FIELD_EXE, command is NULL */
+    int fields;
+
+    /* Base name of the executable wanted by the caller, or NULL. The
+       processes whose short kernel name (comm on Linux, at most 15
+       characters) is not a prefix of it are skipped before their command
+       is read. This is only a hint, some platforms ignore it */
+    const char *name;
+
+    /* Descriptor of a cgroup v2 directory (not owned) whose processes, in
+       the whole subtree, are iterated instead of all the processes of the
+       system, or -1. Only the Linux iterator supports cgroups */
+    int cgroup_fd;
+};
+
+#if defined(__linux__)
+/**
+ * Structure representing the fields of /proc/<pid>/stat used by cpulimit.
+ * Times are expressed in clock ticks.
+ */
+struct proc_stat
+{
+    /* Process state (R, S, D, Z, T...) */
+    char state;
+
+    /* Short name of the process (comm), truncated to 15 characters */
+    char comm[16];
+
+    /* Parent Process ID */
+    int64_t ppid;
+
+    /* Process group ID */
+    int64_t pgrp;
+
+    /* Session ID */
+    int64_t session;
+
+    /* Time spent in user mode */
+    int64_t utime;
+
+    /* Time spent in kernel mode */
+    int64_t stime;
+
+    /* Time spent in user mode by waited-for children */
+    int64_t cutime;
+
+    /* Time spent in kernel mode by waited-for children */
+    int64_t cstime;
+
+    /* Number of threads */
+    int64_t num_threads;
+
+    /* Start time of the process after system boot */
+    int64_t starttime;
 };
 
+/**
+ * Parses the content of a /proc/<pid>/stat file in a single pass,
+ * without allocating memory and regardless of the characters in the
+ * command name.
+ *
+ * @param buf Buffer holding the content of the file.
+ * @param len Length of the content in bytes.
+ * @param st Pointer to the proc_stat structure to fill.
+ * @return 0 on success, -1 if the content is malformed.
+ */
+int parse_proc_stat(const char *buf, size_t len, struct proc_stat *st);
+
+/**
+ * Structure representing one process recorded in a /proc snapshot.
+ */
+struct proc_snapshot_entry
+{
+    /* Process ID of the process */
+    pid_t pid;
+
+    /* Parent Process ID of the process */
+    pid_t ppid;
+
+    /* Start time of the process (in clock ticks after system boot) */
+    int64_t starttime;
+
+    /* CPU time used by the process (in milliseconds) */
+    double cputime;
+
+    /* CPU time used by the waited-for children of the process (in milliseconds) */
+    double children_cputime;
+
+    /* Process state as reported by /proc/<pid>/stat */
+    char state;
+
+    /* Short name of the process (comm), truncated by the kernel */
+    char comm[16];
+
+    /* Flag indicating whether the process matches the filter */
+    char selected;
+
+    /* Tracked process whose descriptor was used to read the entry, or NULL */
+    struct process *known;
+};
+
+/**
+ * Structure representing a snapshot of /proc, in which every
+ * /proc/<pid>/stat file is read exactly once, along with an index
+ * from each process to its children.
+ */
+struct proc_snapshot
+{
+    /* Array of processes sorted by PID */
+    struct proc_snapshot_entry *entries;
+
+    /* Number of processes in the snapshot */
+    int count;
+
+    /* Allocated capacity of the entries array */
+    int capacity;
+
+    /* Children of entries[i] are children[child_first[i]..child_first[i + 1] - 1] */
+    int *child_first;
+
+    /* Indexes in the entries array, grouped by parent */
+    int *children;
+
+    /* Work queue of the traversal selecting the descendants of a process */
+    int *queue;
+
+    /* Allocated capacity of the child_first, children and queue arrays */
+    int index_capacity;
+
+    /* Buffer receiving the entries of the /proc directory */
+    char *dents;
+};
+#endif
+
 /**
  * Structure representing an iterator for processes.
  * This structure provides a way to iterate over processes
@@ -76,8 +275,14 @@ struct process_filter
 struct process_iterator
 {
 #if defined(__linux__)
-    /* Directory stream for accessing the /proc filesystem on Linux */
-    DIR *dip;
+    /* Snapshot of the /proc filesystem on Linux */
+    struct proc_snapshot snap;
+
+    /* Current index in the snapshot */
+    int i;
+
+    /* Total number of processes to iterate, -1 for a single PID */
+    int count;
 #elif defined(__FreeBSD__)
     /* Kernel virtual memory descriptor for accessing process information on FreeBSD */
     kvm_t *kd;
@@ -101,6 +306,9 @@ struct process_iterator
     pid_t *pidlist;
 #endif
 
+    /* Storage of the command of the last process returned */
+    char command[PATH_MAX];
+
     /* Pointer to a process filter to apply during iteration */
     struct process_filter *filter;
 };
@@ -114,6 +322,29 @@ struct process_iterator
  */
 int init_process_iterator(struct process_iterator *it, struct process_filter *filter);
 
+/**
+ * Initializes again a process iterator which has not been closed, to
+ * iterate over the processes from a new snapshot. The memory held by the
+ * iterator is reused, so that scanning the same set of processes
+ * repeatedly does not allocate memory.
+ *
+ * @param it Pointer to the process_iterator structure,
+ *           initialized by init_process_iterator().
+ * @param filter Pointer to the process_filter structure.
+ * @return 0 on success, -1 on failure.
+ */
+int reinit_process_iterator(struct process_iterator *it, struct process_filter *filter);
+
+/**
+ * Sets the number of threads reading the processes of a snapshot.
+ * The listed processes are split into contiguous slices read in parallel,
+ * and a thread is only started for every thousand or so processes.
+ * Only the Linux iterator reads the processes in parallel.
+ *
+ * @param threads Number of threads, 1 to read the processes serially.
+ */
+void set_scan_threads(int threads);
+
 /**
  * Retrieves the next process information in the process iterator.
  *
@@ -131,6 +362,34 @@ int get_next_process(struct process_iterator *it, struct process *p);
  */
 int close_process_iterator(struct process_iterator *it);
 
+/**
+ * Opens the descriptors kept for the whole lifetime of a tracked process,
+ * so that iterations given the process in their known table can sample it
+ * without looking up its /proc entry again. None is opened if they would
+ * leave too few descriptors under the limit of open files, the process
+ * being then sampled through its /proc entry.
+ *
+ * @param p Pointer to the tracked process.
+ */
+void open_process_handles(struct process *p);
+
+/**
+ * Closes the descriptors opened by open_process_handles().
+ *
+ * @param p Pointer to the tracked process.
+ */
+void close_process_handles(struct process *p);
+
+/**
+ * Sends a signal to a process, through its process file descriptor if it
+ * is open, so that the signal cannot reach another process reusing its PID.
+ *
+ * @param p Pointer to the process.
+ * @param sig Signal to send.
+ * @return 0 on success, -1 on failure (e.g. the process has exited).
+ */
+int signal_process(const struct process *p, int sig);
+
 /**
  * Determines if a process is a child of another process.
  *
@@ -140,6 +399,18 @@ int close_process_iterator(struct process_iterator *it);
  */
 int is_child_of(pid_t child_pid, pid_t parent_pid);
 
+/**
+ * Determines if a process is a child of another process, using the process
+ * information already collected by the iterator instead of querying the
+ * system again whenever possible.
+ *
+ * @param it Pointer to the process_iterator structure.
+ * @param child_pid The child process ID.
+ * @param parent_pid The parent process ID.
+ * @return 1 if the child process is a child of the parent process, 0 otherwise.
+ */
+int iterator_is_child_of(const struct process_iterator *it, pid_t child_pid, pid_t parent_pid);
+
 /**
  * Retrieves the parent process ID (PPID) of a given PID.
  *
@@ -148,4 +419,27 @@ int is_child_of(pid_t child_pid, pid_t parent_pid);
  */
 pid_t getppid_of(pid_t pid);
 
+/**
+ * Retrieves the status of the executable file run by a process, which
+ * identifies it by device and inode regardless of the path used to run it.
+ *
+ * @param pid The PID of the process.
+ * @param st Pointer to the stat structure to fill.
+ * @return 0 on success, -1 if the process does not exist or its executable
+ *         cannot be accessed.
+ */
+int stat_process_exe(pid_t pid, struct stat *st);
+
+/**
+ * Reads the CPU time used by each thread of a process, for diagnosis.
+ *
+ * @param pid The PID of the process.
+ * @param threads Array to store the CPU times.
+ * @param max Size of the threads array.
+ * @return Number of threads stored (the first max ones if there are more),
+ *         or -1 on error. errno is set to ENOSYS on the platforms where the
+ *         threads cannot be listed (all but Linux).
+ */
+int read_thread_cputimes(pid_t pid, struct thread_cputime *threads, int max);
+
 #endif
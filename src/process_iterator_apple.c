@@ -33,6 +33,7 @@
 
 #include <errno.h>
 #include <libproc.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -101,13 +102,24 @@ int init_process_iterator(struct process_iterator *it, struct process_filter *fi
     return 0; /* Success */
 }
 
-static int pti2proc(struct proc_taskallinfo *ti, struct process *process)
+static int pti2proc(struct process_iterator *it, struct proc_taskallinfo *ti, struct process *process)
 {
     process->pid = (pid_t)ti->pbsd.pbi_pid;
     process->ppid = (pid_t)ti->pbsd.pbi_ppid;
     process->cputime = ti->ptinfo.pti_total_user / 1e6 + ti->ptinfo.pti_total_system / 1e6;
-    if (proc_pidpath((int)ti->pbsd.pbi_pid, process->command, sizeof(process->command)) <= 0)
+    /* the CPU time of waited children is not reported by libproc */
+    process->children_cputime = 0;
+    process->starttime = (int64_t)ti->pbsd.pbi_start_tvsec * 1000000 + (int64_t)ti->pbsd.pbi_start_tvusec;
+    process->stat_fd = -1;
+    process->pidfd = -1;
+    process->handles = 0;
+    process->command = NULL;
+    /* the path of the executable is both the command and the exe */
+    if (!(it->filter->fields & (PROCESS_FIELD_COMMAND | PROCESS_FIELD_EXE)))
+        return 0;
+    if (proc_pidpath((int)ti->pbsd.pbi_pid, it->command, sizeof(it->command)) <= 0)
         return -1;
+    process->command = it->command;
     return 0;
 }
 
@@ -154,6 +166,31 @@ int is_child_of(pid_t child_pid, pid_t parent_pid)
     return child_pid == parent_pid;
 }
 
+void open_process_handles(struct process *p)
+{
+    p->stat_fd = -1;
+    p->pidfd = -1;
+    p->handles = 0;
+}
+
+void close_process_handles(struct process *p)
+{
+    p->stat_fd = -1;
+    p->pidfd = -1;
+    p->handles = 0;
+}
+
+int signal_process(const struct process *p, int sig)
+{
+    return kill(p->pid, sig);
+}
+
+int iterator_is_child_of(const struct process_iterator *it, pid_t child_pid, pid_t parent_pid)
+{
+    (void)it;
+    return is_child_of(child_pid, parent_pid);
+}
+
 int get_next_process(struct process_iterator *it, struct process *p)
 {
     if (it->i >= it->count)
@@ -161,7 +198,7 @@ int get_next_process(struct process_iterator *it, struct process *p)
     if (it->filter->pid != 0 && !it->filter->include_children)
     {
         struct proc_taskallinfo ti;
-        if (get_process_pti(it->filter->pid, &ti) == 0 && pti2proc(&ti, p) == 0)
+        if (get_process_pti(it->filter->pid, &ti) == 0 && pti2proc(it, &ti, p) == 0)
         {
             it->i = it->count = 1;
             return 0;
@@ -185,7 +222,7 @@ int get_next_process(struct process_iterator *it, struct process *p)
         if (it->filter->pid != 0 && it->filter->include_children)
         {
             it->i++;
-            if (pti2proc(&ti, p) != 0)
+            if (pti2proc(it, &ti, p) != 0)
                 continue;
             if (p->pid != it->filter->pid && !is_child_of(p->pid, it->filter->pid))
                 continue;
@@ -194,7 +231,7 @@ int get_next_process(struct process_iterator *it, struct process *p)
         else if (it->filter->pid == 0)
         {
             it->i++;
-            if (pti2proc(&ti, p) != 0)
+            if (pti2proc(it, &ti, p) != 0)
                 continue;
             return 0;
         }
@@ -202,6 +239,37 @@ int get_next_process(struct process_iterator *it, struct process *p)
     return -1;
 }
 
+int reinit_process_iterator(struct process_iterator *it, struct process_filter *filter)
+{
+    /* the process list is retrieved into a new buffer anyway */
+    if (close_process_iterator(it) != 0)
+        return -1;
+    return init_process_iterator(it, filter);
+}
+
+int stat_process_exe(pid_t pid, struct stat *st)
+{
+    char path[PROC_PIDPATHINFO_MAXSIZE];
+    if (proc_pidpath((int)pid, path, sizeof(path)) <= 0)
+        return -1;
+    return stat(path, st) == 0 ? 0 : -1;
+}
+
+int read_thread_cputimes(pid_t pid, struct thread_cputime *threads, int max)
+{
+    (void)pid;
+    (void)threads;
+    (void)max;
+    errno = ENOSYS;
+    return -1;
+}
+
+void set_scan_threads(int threads)
+{
+    /* the process list is retrieved with a single call */
+    (void)threads;
+}
+
 int close_process_iterator(struct process_iterator *it)
 {
     free(it->pidlist);
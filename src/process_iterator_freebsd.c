@@ -32,12 +32,14 @@
 #define inline
 #endif
 
+#include <errno.h>
 #include <fcntl.h>
 #include <kvm.h>
 #include <sys/param.h>
 #include <sys/user.h>
 #include <sys/sysctl.h>
 #include <paths.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -81,26 +83,36 @@ int init_process_iterator(struct process_iterator *it, struct process_filter *fi
     return 0;
 }
 
-static int kproc2proc(kvm_t *kd, struct kinfo_proc *kproc, struct process *proc)
+static int kproc2proc(struct process_iterator *it, struct kinfo_proc *kproc, struct process *proc)
 {
     char **args;
     size_t len_max;
     proc->pid = kproc->ki_pid;
     proc->ppid = kproc->ki_ppid;
     proc->cputime = (double)kproc->ki_runtime / 1000.0;
-    len_max = sizeof(proc->command) - 1;
-    if ((args = kvm_getargv(kd, kproc, (int)len_max)) == NULL)
+    proc->children_cputime = (double)(kproc->ki_childutime.tv_sec + kproc->ki_childstime.tv_sec) * 1000.0 +
+                             (double)(kproc->ki_childutime.tv_usec + kproc->ki_childstime.tv_usec) / 1000.0;
+    proc->starttime = (int64_t)kproc->ki_start.tv_sec * 1000000 + kproc->ki_start.tv_usec;
+    proc->stat_fd = -1;
+    proc->pidfd = -1;
+    proc->handles = 0;
+    proc->command = NULL;
+    if (!(it->filter->fields & (PROCESS_FIELD_COMMAND | PROCESS_FIELD_EXE)))
+        return 0;
+    len_max = sizeof(it->command) - 1;
+    if ((args = kvm_getargv(it->kd, kproc, (int)len_max)) == NULL)
         return -1;
-    strncpy(proc->command, args[0], len_max);
-    proc->command[len_max] = '\0';
+    strncpy(it->command, args[0], len_max);
+    it->command[len_max] = '\0';
+    proc->command = it->command;
     return 0;
 }
 
-static int get_single_process(kvm_t *kd, pid_t pid, struct process *process)
+static int get_single_process(struct process_iterator *it, pid_t pid, struct process *process)
 {
     int count;
-    struct kinfo_proc *kproc = kvm_getprocs(kd, KERN_PROC_PID, pid, &count);
-    if (count == 0 || kproc == NULL || kproc2proc(kd, kproc, process) != 0)
+    struct kinfo_proc *kproc = kvm_getprocs(it->kd, KERN_PROC_PID, pid, &count);
+    if (count == 0 || kproc == NULL || kproc2proc(it, kproc, process) != 0)
         return -1;
     return 0;
 }
@@ -169,6 +181,30 @@ int is_child_of(pid_t child_pid, pid_t parent_pid)
     return ret;
 }
 
+void open_process_handles(struct process *p)
+{
+    p->stat_fd = -1;
+    p->pidfd = -1;
+    p->handles = 0;
+}
+
+void close_process_handles(struct process *p)
+{
+    p->stat_fd = -1;
+    p->pidfd = -1;
+    p->handles = 0;
+}
+
+int signal_process(const struct process *p, int sig)
+{
+    return kill(p->pid, sig);
+}
+
+int iterator_is_child_of(const struct process_iterator *it, pid_t child_pid, pid_t parent_pid)
+{
+    return _is_child_of(it->kd, child_pid, parent_pid);
+}
+
 int get_next_process(struct process_iterator *it, struct process *p)
 {
     if (it->i >= it->count)
@@ -177,7 +213,7 @@ int get_next_process(struct process_iterator *it, struct process *p)
     }
     if (it->filter->pid != 0 && !it->filter->include_children)
     {
-        if (get_single_process(it->kd, it->filter->pid, p) != 0)
+        if (get_single_process(it, it->filter->pid, p) != 0)
         {
             it->i = it->count = 0;
             return -1;
@@ -197,7 +233,7 @@ int get_next_process(struct process_iterator *it, struct process *p)
         if (it->filter->pid != 0 && it->filter->include_children)
         {
             it->i++;
-            if (kproc2proc(it->kd, kproc, p) != 0)
+            if (kproc2proc(it, kproc, p) != 0)
                 continue;
             if (p->pid != it->filter->pid &&
                 !_is_child_of(it->kd, p->pid, it->filter->pid))
@@ -207,7 +243,7 @@ int get_next_process(struct process_iterator *it, struct process *p)
         else if (it->filter->pid == 0)
         {
             it->i++;
-            if (kproc2proc(it->kd, kproc, p) != 0)
+            if (kproc2proc(it, kproc, p) != 0)
                 continue;
             return 0;
         }
@@ -215,6 +251,40 @@ int get_next_process(struct process_iterator *it, struct process *p)
     return -1;
 }
 
+int reinit_process_iterator(struct process_iterator *it, struct process_filter *filter)
+{
+    /* the process list is retrieved into a new buffer anyway */
+    if (close_process_iterator(it) != 0)
+        return -1;
+    return init_process_iterator(it, filter);
+}
+
+int stat_process_exe(pid_t pid, struct stat *st)
+{
+    char path[PATH_MAX];
+    size_t len = sizeof(path);
+    int mib[4] = {CTL_KERN, KERN_PROC, KERN_PROC_PATHNAME, 0};
+    mib[3] = (int)pid;
+    if (sysctl(mib, 4, path, &len, NULL, 0) != 0 || len == 0)
+        return -1;
+    return stat(path, st) == 0 ? 0 : -1;
+}
+
+int read_thread_cputimes(pid_t pid, struct thread_cputime *threads, int max)
+{
+    (void)pid;
+    (void)threads;
+    (void)max;
+    errno = ENOSYS;
+    return -1;
+}
+
+void set_scan_threads(int threads)
+{
+    /* the process list is retrieved with a single call */
+    (void)threads;
+}
+
 int close_process_iterator(struct process_iterator *it)
 {
     free(it->procs);
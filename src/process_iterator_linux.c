@@ -31,99 +31,880 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/vfs.h>
 #include <time.h>
 #include <unistd.h>
 
 #include "process_iterator.h"
+#include "process_table.h"
+#include "util.h"
 
+/* Size of the buffer used to read /proc/<pid>/stat */
+#define STAT_BUFSIZE 1024
+
+/* Size of the buffer used to list /proc with getdents64 */
+#define DENTS_BUFSIZE (256 * 1024)
+
+#ifndef PROC_SUPER_MAGIC
+#define PROC_SUPER_MAGIC 0x9fa0
+#endif
+
+/* Directory entry returned by getdents64, whose name is NUL-terminated */
+struct linux_dirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+
+/* Descriptor of the /proc directory, kept open for openat() and getdents64 */
+static int proc_fd = -1;
+
+/* Flag cleared when the kernel does not support process file descriptors */
+static int pidfd_supported = 1;
+
+/* Descriptors left by the handles of the tracked processes to the scans,
+   the process events and the event loop */
+#define RESERVED_FDS 64
+
+/* Number of handles opened for the tracked processes, and the maximum
+   allowed by the limit of open files (-1 until it is read) */
+static int handles_open = 0;
+static int handles_max = -1;
+
+static int get_proc_fd(void)
+{
+    if (proc_fd < 0)
+    {
+        proc_fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        syscall_count++;
+    }
+    return proc_fd;
+}
+
+/* check that procfs is mounted, once for all since its descriptor stays open */
 static int check_proc(void)
 {
-    struct stat statbuf;
-    return stat("/proc", &statbuf) == 0 && S_ISDIR(statbuf.st_mode);
+    static int proc_checked = 0;
+    struct statfs st;
+    if (!proc_checked)
+    {
+        syscall_count++;
+        proc_checked = get_proc_fd() >= 0 &&
+                       fstatfs(proc_fd, &st) == 0 && st.f_type == PROC_SUPER_MAGIC;
+    }
+    return proc_checked;
 }
 
-int init_process_iterator(struct process_iterator *it, struct process_filter *filter)
+/* open a file of /proc/<pid>, name being relative to it (such as task/<tid>/stat) */
+static int open_proc_file(pid_t pid, const char *name)
 {
-    if (!check_proc())
+    char path[NAME_MAX + 32];
+    int len = snprintf(path, sizeof(path), "%ld/%s", (long)pid, name);
+    if (len < 0 || (size_t)len >= sizeof(path))
     {
-        fprintf(stderr, "procfs is not mounted!\nAborting\n");
-        exit(EXIT_FAILURE);
+        errno = ENAMETOOLONG;
+        return -1;
     }
-    /* open a directory stream to /proc directory */
-    if ((it->dip = opendir("/proc")) == NULL)
+    return openat(get_proc_fd(), path, O_RDONLY | O_CLOEXEC);
+}
+
+/* read a file of /proc/<pid> into buf, return the number of bytes read or -1.
+   The system calls are counted in *syscalls, which is private to each scan thread */
+static ssize_t read_proc_file(pid_t pid, const char *name, char *buf, size_t size, unsigned long *syscalls)
+{
+    ssize_t n;
+    int fd = open_proc_file(pid, name);
+    (*syscalls)++;
+    if (fd < 0)
     {
-        perror("opendir");
         return -1;
     }
-    it->filter = filter;
-    return 0;
+    n = read(fd, buf, size);
+    close(fd);
+    *syscalls += 2;
+    return n;
 }
 
-static int read_process_info(pid_t pid, struct process *p)
+static long get_clk_tck(void)
 {
-    char statfile[32], exefile[32], state;
-    double usertime, systime;
-    long ppid;
-    FILE *fd;
     static long sc_clk_tck = -1;
+    if (sc_clk_tck < 0)
+    {
+        sc_clk_tck = sysconf(_SC_CLK_TCK);
+    }
+    return sc_clk_tck;
+}
 
-    p->pid = pid;
+static int is_zombie(char state)
+{
+    return strchr("ZXx", state) != NULL;
+}
 
-    /* read command line */
-    sprintf(exefile, "/proc/%ld/cmdline", (long)p->pid);
-    if ((fd = fopen(exefile, "r")) == NULL)
+static struct process *find_known(const struct process_filter *filter, pid_t pid)
+{
+    if (filter == NULL || filter->known == NULL)
+    {
+        return NULL;
+    }
+    return process_table_find_pid(filter->known, pid);
+}
+
+/* Word of bytes scanned at once when looking for field separators */
+typedef uint64_t stat_word;
+
+/* 0x0101...01 and the derived masks, built without 64-bit literals */
+#define WORD_ONES (~(stat_word)0 / 255)
+#define WORD_LOWS (WORD_ONES * 0x7F)
+
+/* set the high bit of every byte of w equal to ' ', and only of those */
+static stat_word space_mask(stat_word w)
+{
+    stat_word x = w ^ (WORD_ONES * (unsigned char)' ');
+    return ~(((x & WORD_LOWS) + WORD_LOWS) | x | WORD_LOWS);
+}
+
+/* skip n fields, return the start of the following field or NULL */
+static const char *skip_fields(const char *p, const char *end, int n)
+{
+    /* count the separators eight bytes at a time */
+    while (n > 0 && end - p >= (long)sizeof(stat_word))
+    {
+        stat_word w;
+        int count;
+        memcpy(&w, p, sizeof(w));
+        count = (int)((((space_mask(w) >> 7) * WORD_ONES) >> (8 * (sizeof(w) - 1))));
+        if (count >= n)
+            break;
+        n -= count;
+        p += sizeof(w);
+    }
+    for (; n > 0 && p < end; p++)
+    {
+        if (*p == ' ')
+            n--;
+    }
+    return n == 0 ? p : NULL;
+}
+
+/* parse a decimal field and the separator following it */
+static const char *parse_field(const char *p, const char *end, int64_t *value)
+{
+    int negative = 0;
+    int64_t v = 0;
+    if (p < end && *p == '-')
+    {
+        negative = 1;
+        p++;
+    }
+    if (p >= end || *p < '0' || *p > '9')
+        return NULL;
+    for (; p < end && *p >= '0' && *p <= '9'; p++)
+        v = v * 10 + (*p - '0');
+    if (p < end && *p != ' ' && *p != '\n')
+        return NULL;
+    *value = negative ? -v : v;
+    return p < end ? p + 1 : p;
+}
+
+int parse_proc_stat(const char *buf, size_t len, struct proc_stat *st)
+{
+    const char *end = buf + len, *p, *comm;
+    size_t comm_len;
+
+    /* the command name may contain anything, including ')' */
+    p = (const char *)memrchr(buf, ')', len);
+    comm = (const char *)memchr(buf, '(', len);
+    if (p == NULL || comm == NULL || comm > p || end - p < 4 || p[1] != ' ' || p[3] != ' ')
+        return -1;
+    comm_len = MIN((size_t)(p - comm - 1), sizeof(st->comm) - 1);
+    memcpy(st->comm, comm + 1, comm_len);
+    st->comm[comm_len] = '\0';
+    st->state = p[2];
+    p += 4;
+    /* fields 4 to 6 */
+    if ((p = parse_field(p, end, &st->ppid)) == NULL ||
+        (p = parse_field(p, end, &st->pgrp)) == NULL ||
+        (p = parse_field(p, end, &st->session)) == NULL)
+        return -1;
+    /* fields 14 to 17, after tty_nr, tpgid, flags and page faults */
+    if ((p = skip_fields(p, end, 7)) == NULL ||
+        (p = parse_field(p, end, &st->utime)) == NULL ||
+        (p = parse_field(p, end, &st->stime)) == NULL ||
+        (p = parse_field(p, end, &st->cutime)) == NULL ||
+        (p = parse_field(p, end, &st->cstime)) == NULL)
+        return -1;
+    /* field 20, after priority and nice */
+    if ((p = skip_fields(p, end, 2)) == NULL ||
+        (p = parse_field(p, end, &st->num_threads)) == NULL)
+        return -1;
+    /* field 22, after itrealvalue */
+    if ((p = skip_fields(p, end, 1)) == NULL ||
+        parse_field(p, end, &st->starttime) == NULL)
+        return -1;
+    return 0;
+}
+
+/* read /proc/<pid>/stat, through the persistent descriptor of a known process if any */
+static int read_proc_stat(pid_t pid, struct process *known, struct proc_snapshot_entry *e,
+                          unsigned long *syscalls)
+{
+    char buf[STAT_BUFSIZE];
+    struct proc_stat st;
+    ssize_t n = -1;
+
+    if (known != NULL && known->stat_fd >= 0)
+    {
+        n = pread(known->stat_fd, buf, sizeof(buf), 0);
+        (*syscalls)++;
+        if (n < 0)
+        {
+            int err = errno;
+            /* the descriptor no longer guarantees the identity of the process */
+            close(known->stat_fd);
+            known->stat_fd = -1;
+            (*syscalls)++;
+            if (err == ESRCH)
+            {
+                /* the process is gone */
+                return -1;
+            }
+        }
+    }
+    if (n < 0 && (n = read_proc_file(pid, "stat", buf, sizeof(buf), syscalls)) < 0)
+    {
+        return -1;
+    }
+    if (parse_proc_stat(buf, (size_t)n, &st) != 0)
     {
         return -1;
     }
-    if (fgets(p->command, sizeof(p->command), fd) == NULL)
+    e->pid = pid;
+    e->ppid = (pid_t)st.ppid;
+    e->starttime = st.starttime;
+    e->cputime = (double)(st.utime + st.stime) * 1000.0 / (double)get_clk_tck();
+    e->children_cputime = (double)(st.cutime + st.cstime) * 1000.0 / (double)get_clk_tck();
+    e->state = st.state;
+    memcpy(e->comm, st.comm, sizeof(e->comm));
+    e->selected = 0;
+    /* only a descriptor still open guarantees that the pid was not reused */
+    e->known = (known != NULL && known->stat_fd >= 0) ? known : NULL;
+    return 0;
+}
+
+static int read_process_cmdline(pid_t pid, char *command)
+{
+    ssize_t n = read_proc_file(pid, "cmdline", command, PATH_MAX - 1, &syscall_count);
+    if (n <= 0)
     {
-        fclose(fd);
         return -1;
     }
-    fclose(fd);
+    command[n] = '\0';
+    return 0;
+}
 
-    /* read stat file */
-    sprintf(statfile, "/proc/%ld/stat", (long)p->pid);
-    if ((fd = fopen(statfile, "r")) == NULL)
+static int read_process_exe(pid_t pid, char *command)
+{
+    char path[32];
+    ssize_t n;
+    sprintf(path, "%ld/exe", (long)pid);
+    n = readlinkat(get_proc_fd(), path, command, PATH_MAX - 1);
+    syscall_count++;
+    if (n <= 0)
     {
         return -1;
     }
-    if (fscanf(fd, "%*d (%*[^)]) %c %ld %*d %*d %*d %*d %*d %*d %*d %*d %*d %lf %lf",
-               &state, &ppid, &usertime, &systime) != 4 ||
-        strchr("ZXx", state) != NULL)
+    command[n] = '\0';
+    return 0;
+}
+
+/* tell whether the short kernel name of a process may belong to the wanted executable */
+static int comm_matches(const struct proc_snapshot_entry *e, const char *name)
+{
+    return name == NULL || strncmp(e->comm, name, sizeof(e->comm) - 1) == 0;
+}
+
+/* read the command only if the caller asked for it */
+static int read_process_command(struct process_iterator *it, const struct proc_snapshot_entry *e, struct process *p)
+{
+    int fields = it->filter->fields;
+    p->command = NULL;
+    if (fields & PROCESS_FIELD_EXE)
     {
-        fclose(fd);
+        if (read_process_exe(e->pid, it->command) != 0)
+            return -1;
+        p->command = it->command;
+        return 0;
+    }
+    if (!(fields & PROCESS_FIELD_COMMAND))
+        return 0;
+    if (e->known != NULL && e->known->command != NULL)
+    {
+        /* the command line of a tracked process is already known */
+        p->command = e->known->command;
+        return 0;
+    }
+    if (read_process_cmdline(e->pid, it->command) != 0)
         return -1;
+    p->command = it->command;
+    return 0;
+}
+
+static int open_pidfd(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    int fd;
+    if (!pidfd_supported)
+        return -1;
+    fd = (int)syscall(SYS_pidfd_open, pid, 0);
+    syscall_count++;
+    if (fd < 0 && errno == ENOSYS)
+        pidfd_supported = 0;
+    return fd;
+#else
+    (void)pid;
+    return -1;
+#endif
+}
+
+/* read the limit of open files, which may have been raised */
+static void read_handles_max(void)
+{
+    struct rlimit rl;
+    syscall_count++;
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0 || rl.rlim_cur == RLIM_INFINITY ||
+        rl.rlim_cur > (rlim_t)INT_MAX)
+        handles_max = INT_MAX;
+    else
+        handles_max = (int)rl.rlim_cur - RESERVED_FDS;
+}
+
+void open_process_handles(struct process *p)
+{
+    struct proc_snapshot_entry e;
+    /* the stat descriptor may have been closed by a failed read, not the pidfd */
+    close_process_handles(p);
+    if (handles_open == 0 || handles_max < 0)
+        read_handles_max();
+    if (handles_open + 2 > handles_max)
+        return;
+    errno = 0;
+    p->pidfd = open_pidfd(p->pid);
+    /* other descriptors took the reserve: stop opening handles until they are all closed */
+    if (p->pidfd < 0 && errno == EMFILE)
+        handles_max = handles_open;
+    p->stat_fd = open_proc_file(p->pid, "stat");
+    syscall_count++;
+    if (p->stat_fd < 0 && errno == EMFILE)
+        handles_max = handles_open;
+    p->handles = (p->pidfd >= 0) + (p->stat_fd >= 0);
+    handles_open += p->handles;
+    /* the pid may have been reused before the descriptors were opened */
+    if ((p->pidfd >= 0 || p->stat_fd >= 0) &&
+        (read_proc_stat(p->pid, p, &e, &syscall_count) != 0 || e.starttime != p->starttime))
+    {
+        close_process_handles(p);
     }
-    fclose(fd);
-    p->ppid = (pid_t)ppid;
-    if (sc_clk_tck < 0)
+}
+
+void close_process_handles(struct process *p)
+{
+    if (p->stat_fd >= 0)
     {
-        sc_clk_tck = sysconf(_SC_CLK_TCK);
+        close(p->stat_fd);
+        syscall_count++;
+        p->stat_fd = -1;
     }
-    p->cputime = (usertime + systime) * 1000.0 / (double)sc_clk_tck;
+    if (p->pidfd >= 0)
+    {
+        close(p->pidfd);
+        syscall_count++;
+        p->pidfd = -1;
+    }
+    /* a stat descriptor closed by a failed read is accounted until now */
+    handles_open -= p->handles;
+    p->handles = 0;
+}
+
+int signal_process(const struct process *p, int sig)
+{
+#ifdef SYS_pidfd_send_signal
+    if (p->pidfd >= 0)
+        return syscall(SYS_pidfd_send_signal, p->pidfd, sig, NULL, 0) == 0 ? 0 : -1;
+#endif
+    return kill(p->pid, sig);
+}
+
+static void fill_process(const struct proc_snapshot_entry *e, struct process *p)
+{
+    p->pid = e->pid;
+    p->ppid = e->ppid;
+    p->starttime = e->starttime;
+    p->cputime = e->cputime;
+    p->children_cputime = e->children_cputime;
+    p->stat_fd = -1;
+    p->pidfd = -1;
+    p->handles = 0;
+}
 
+static int read_process_info(struct process_iterator *it, pid_t pid, struct process *p)
+{
+    struct proc_snapshot_entry e;
+    if (pid <= 0 ||
+        read_proc_stat(pid, find_known(it->filter, pid), &e, &syscall_count) != 0 ||
+        is_zombie(e.state) ||
+        !comm_matches(&e, it->filter->name) ||
+        read_process_command(it, &e, p) != 0)
+    {
+        return -1;
+    }
+    fill_process(&e, p);
     return 0;
 }
 
+/* parse a /proc entry name made of digits only, return 0 if it is not a PID */
+static pid_t parse_pid(const char *name)
+{
+    long pid = 0;
+    if (*name == '\0')
+        return 0;
+    for (; *name != '\0'; name++)
+    {
+        if (*name < '0' || *name > '9' || pid > (LONG_MAX - 9) / 10)
+            return 0;
+        pid = pid * 10 + (*name - '0');
+    }
+    return (pid_t)pid == pid ? (pid_t)pid : 0;
+}
+
+static int compare_entry_pid(const void *a, const void *b)
+{
+    pid_t pid_a = ((const struct proc_snapshot_entry *)a)->pid;
+    pid_t pid_b = ((const struct proc_snapshot_entry *)b)->pid;
+    return (pid_a > pid_b) - (pid_a < pid_b);
+}
+
+static int snapshot_find(const struct proc_snapshot *snap, pid_t pid)
+{
+    int lo = 0, hi = snap->count - 1;
+    while (lo <= hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (snap->entries[mid].pid == pid)
+            return mid;
+        if (snap->entries[mid].pid < pid)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return -1;
+}
+
+/* append a process to the snapshot, growing it if needed */
+static struct proc_snapshot_entry *snapshot_add(struct proc_snapshot *snap)
+{
+    if (snap->count == snap->capacity)
+    {
+        snap->capacity = snap->capacity > 0 ? snap->capacity * 2 : 256;
+        snap->entries = (struct proc_snapshot_entry *)realloc(
+            snap->entries, sizeof(struct proc_snapshot_entry) * (size_t)snap->capacity);
+        if (snap->entries == NULL)
+        {
+            fprintf(stderr, "Memory allocation failed for the process snapshot\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return &snap->entries[snap->count++];
+}
+
+/* list the PIDs of the processes with getdents64 on the descriptor of /proc */
+static int snapshot_list_pids(struct proc_snapshot *snap)
+{
+    int fd = get_proc_fd();
+    if (snap->dents == NULL &&
+        (snap->dents = (char *)malloc(DENTS_BUFSIZE)) == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed for the directory buffer\n");
+        exit(EXIT_FAILURE);
+    }
+    snap->count = 0;
+    syscall_count++;
+    if (fd < 0 || lseek(fd, 0, SEEK_SET) != 0)
+    {
+        perror("lseek");
+        return -1;
+    }
+    while (1)
+    {
+        long pos, n = syscall(SYS_getdents64, fd, snap->dents, DENTS_BUFSIZE);
+        syscall_count++;
+        if (n < 0)
+        {
+            perror("getdents64");
+            return -1;
+        }
+        if (n == 0)
+            break;
+        for (pos = 0; pos < n;)
+        {
+            const struct linux_dirent64 *d = (const struct linux_dirent64 *)(const void *)(snap->dents + pos);
+            pid_t pid;
+            pos += d->d_reclen;
+            /* the processes are directories, DT_UNKNOWN is left to the parser */
+            if (d->d_type != DT_DIR && d->d_type != DT_UNKNOWN)
+                continue;
+            if ((pid = parse_pid(d->d_name)) > 0)
+                snapshot_add(snap)->pid = pid;
+        }
+    }
+    return 0;
+}
+
+/* Size of the buffers used to read a cgroup directory and its cgroup.procs */
+#define CGROUP_BUFSIZE 4096
+
+/* list the processes of a cgroup and of its descendants, in no particular order */
+static int snapshot_list_cgroup(struct proc_snapshot *snap, int dirfd)
+{
+    char buf[CGROUP_BUFSIZE];
+    long n, pos;
+    pid_t pid = 0;
+    int fd = openat(dirfd, "cgroup.procs", O_RDONLY | O_CLOEXEC);
+    syscall_count++;
+    if (fd < 0)
+        return -1;
+    /* one PID per line, a PID may span two reads */
+    while ((n = (long)read(fd, buf, sizeof(buf))) > 0)
+    {
+        syscall_count++;
+        for (pos = 0; pos < n; pos++)
+        {
+            if (buf[pos] >= '0' && buf[pos] <= '9')
+                pid = pid * 10 + (buf[pos] - '0');
+            else if (pid > 0)
+            {
+                snapshot_add(snap)->pid = pid;
+                pid = 0;
+            }
+        }
+    }
+    syscall_count += 2;
+    close(fd);
+    if (n < 0)
+        return -1;
+    if (pid > 0)
+        snapshot_add(snap)->pid = pid;
+    /* then the child cgroups, which are the subdirectories */
+    syscall_count++;
+    if (lseek(dirfd, 0, SEEK_SET) != 0)
+        return -1;
+    while ((n = syscall(SYS_getdents64, dirfd, buf, sizeof(buf))) > 0)
+    {
+        syscall_count++;
+        for (pos = 0; pos < n;)
+        {
+            const struct linux_dirent64 *d = (const struct linux_dirent64 *)(const void *)(buf + pos);
+            int child, ret;
+            pos += d->d_reclen;
+            if (d->d_type != DT_DIR || strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0)
+                continue;
+            child = openat(dirfd, d->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            syscall_count += 2;
+            /* a child cgroup removed meanwhile is skipped */
+            if (child < 0)
+                continue;
+            ret = snapshot_list_cgroup(snap, child);
+            close(child);
+            if (ret != 0)
+                return -1;
+        }
+    }
+    syscall_count++;
+    return n < 0 ? -1 : 0;
+}
+
+/* Minimum number of processes given to each scan thread */
+#define SCAN_SLICE_MIN 1024
+
+/* Maximum number of threads reading /proc/<pid>/stat */
+#define SCAN_THREADS_MAX 64
+
+/* Number of threads reading /proc/<pid>/stat, set by set_scan_threads() */
+static int scan_threads = 1;
+
+/* Slice of the listed processes read by one scan thread */
+struct scan_slice
+{
+    struct proc_snapshot *snap;
+    const struct process_filter *filter;
+    int begin;
+    int end;
+    /* number of entries kept, compacted at the beginning of the slice */
+    int count;
+    int sorted;
+    unsigned long syscalls;
+    pthread_t thread;
+};
+
+void set_scan_threads(int threads)
+{
+    scan_threads = MAX(1, MIN(threads, SCAN_THREADS_MAX));
+}
+
+/* read the stat files of a slice, keeping in place the processes still alive */
+static void *scan_slice_read(void *arg)
+{
+    struct scan_slice *slice = (struct scan_slice *)arg;
+    struct proc_snapshot_entry *entries = slice->snap->entries;
+    int i, n = slice->begin;
+    slice->sorted = 1;
+    slice->syscalls = 0;
+    for (i = slice->begin; i < slice->end; i++)
+    {
+        pid_t pid = entries[i].pid;
+        if (read_proc_stat(pid, find_known(slice->filter, pid), &entries[n], &slice->syscalls) != 0)
+            continue;
+        if (n > slice->begin && entries[n - 1].pid > pid)
+            slice->sorted = 0;
+        n++;
+    }
+    slice->count = n - slice->begin;
+    return NULL;
+}
+
+/* read /proc/<pid>/stat of every process exactly once */
+static int snapshot_read(struct proc_snapshot *snap, const struct process_filter *filter)
+{
+    struct scan_slice slices[SCAN_THREADS_MAX];
+    int i, count, nslices, started, sorted = 1;
+    snap->count = 0;
+    if ((filter->cgroup_fd >= 0 ? snapshot_list_cgroup(snap, filter->cgroup_fd)
+                                : snapshot_list_pids(snap)) != 0)
+        return -1;
+    count = snap->count;
+    /* threads only pay off when each of them has enough processes to read */
+    nslices = MAX(1, MIN(scan_threads, count / SCAN_SLICE_MIN));
+    /* initialize the shared state before the threads use it */
+    get_clk_tck();
+    for (i = 0; i < nslices; i++)
+    {
+        slices[i].snap = snap;
+        slices[i].filter = filter;
+        slices[i].begin = (int)((long)count * i / nslices);
+        slices[i].end = (int)((long)count * (i + 1) / nslices);
+    }
+    for (started = 1; started < nslices; started++)
+    {
+        if (pthread_create(&slices[started].thread, NULL, scan_slice_read, &slices[started]) != 0)
+            break;
+    }
+    /* the calling thread reads the first slice and those left without a thread */
+    scan_slice_read(&slices[0]);
+    for (i = started; i < nslices; i++)
+        scan_slice_read(&slices[i]);
+    snap->count = 0;
+    for (i = 0; i < nslices; i++)
+    {
+        const struct scan_slice *slice = &slices[i];
+        if (i > 0 && i < started)
+            pthread_join(slice->thread, NULL);
+        syscall_count += slice->syscalls;
+        /* the slices are merged in the order of the listing */
+        if (slice->count == 0)
+            continue;
+        if (snap->count != slice->begin)
+        {
+            memmove(&snap->entries[snap->count], &snap->entries[slice->begin],
+                    (size_t)slice->count * sizeof(struct proc_snapshot_entry));
+        }
+        if (!slice->sorted ||
+            (snap->count > 0 && snap->entries[snap->count - 1].pid > snap->entries[snap->count].pid))
+            sorted = 0;
+        snap->count += slice->count;
+    }
+    if (!sorted)
+    {
+        qsort(snap->entries, (size_t)snap->count,
+              sizeof(struct proc_snapshot_entry), compare_entry_pid);
+    }
+    return 0;
+}
+
+/* build the parent->children adjacency index of the snapshot */
+static void snapshot_index_children(struct proc_snapshot *snap)
+{
+    int i;
+    if (snap->index_capacity < snap->count + 1)
+    {
+        snap->index_capacity = snap->capacity + 1;
+        snap->child_first = (int *)realloc(snap->child_first, sizeof(int) * (size_t)snap->index_capacity);
+        snap->children = (int *)realloc(snap->children, sizeof(int) * (size_t)snap->index_capacity);
+        snap->queue = (int *)realloc(snap->queue, sizeof(int) * (size_t)snap->index_capacity);
+        if (snap->child_first == NULL || snap->children == NULL || snap->queue == NULL)
+        {
+            fprintf(stderr, "Memory allocation failed for the process snapshot\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    memset(snap->child_first, 0, sizeof(int) * ((size_t)snap->count + 1));
+    /* count the children of every process */
+    for (i = 0; i < snap->count; i++)
+    {
+        int parent = snapshot_find(snap, snap->entries[i].ppid);
+        if (parent >= 0)
+            snap->child_first[parent + 1]++;
+    }
+    for (i = 0; i < snap->count; i++)
+    {
+        snap->child_first[i + 1] += snap->child_first[i];
+    }
+    /* place children, using child_first[parent] as cursor */
+    for (i = 0; i < snap->count; i++)
+    {
+        int parent = snapshot_find(snap, snap->entries[i].ppid);
+        if (parent >= 0)
+            snap->children[snap->child_first[parent]++] = i;
+    }
+    /* every cursor now points to the start of the next group */
+    for (i = snap->count; i > 0; i--)
+    {
+        snap->child_first[i] = snap->child_first[i - 1];
+    }
+    snap->child_first[0] = 0;
+}
+
+/* mark the process and all of its descendants with one traversal */
+static void snapshot_select_descendants(struct proc_snapshot *snap, pid_t pid)
+{
+    int *queue = snap->queue, head = 0, tail = 0;
+    int root = snapshot_find(snap, pid);
+    if (root < 0)
+        return;
+    snap->entries[root].selected = 1;
+    queue[tail++] = root;
+    while (head < tail)
+    {
+        int parent = queue[head++], k;
+        for (k = snap->child_first[parent]; k < snap->child_first[parent + 1]; k++)
+        {
+            struct proc_snapshot_entry *child = &snap->entries[snap->children[k]];
+            /* a child cannot be older than its parent, unless the PID was reused */
+            if (child->selected ||
+                child->starttime < snap->entries[parent].starttime)
+                continue;
+            child->selected = 1;
+            queue[tail++] = snap->children[k];
+        }
+    }
+}
+
+int init_process_iterator(struct process_iterator *it, struct process_filter *filter)
+{
+    it->snap.entries = NULL;
+    it->snap.count = it->snap.capacity = 0;
+    it->snap.child_first = it->snap.children = it->snap.queue = NULL;
+    it->snap.index_capacity = 0;
+    it->snap.dents = NULL;
+    return reinit_process_iterator(it, filter);
+}
+
+int reinit_process_iterator(struct process_iterator *it, struct process_filter *filter)
+{
+    int i;
+    it->i = 0;
+    it->count = 0;
+    it->filter = filter;
+    if (!check_proc())
+    {
+        fprintf(stderr, "procfs is not mounted!\nAborting\n");
+        exit(EXIT_FAILURE);
+    }
+    if (filter->pid != 0 && !filter->include_children)
+    {
+        /* a single process, no need to scan /proc */
+        it->count = 1;
+        return 0;
+    }
+    if (snapshot_read(&it->snap, filter) != 0)
+    {
+        return -1;
+    }
+    it->count = it->snap.count;
+    if (filter->pid == 0)
+    {
+        for (i = 0; i < it->snap.count; i++)
+            it->snap.entries[i].selected = 1;
+    }
+    else
+    {
+        snapshot_index_children(&it->snap);
+        snapshot_select_descendants(&it->snap, filter->pid);
+    }
+    return 0;
+}
+
+int stat_process_exe(pid_t pid, struct stat *st)
+{
+    char path[32];
+    sprintf(path, "%ld/exe", (long)pid);
+    syscall_count++;
+    /* the link is followed to the executable, even if it has been deleted */
+    return fstatat(get_proc_fd(), path, st, 0) == 0 ? 0 : -1;
+}
+
+int read_thread_cputimes(pid_t pid, struct thread_cputime *threads, int max)
+{
+    char path[NAME_MAX + 16], buf[STAT_BUFSIZE];
+    struct dirent *d;
+    DIR *dir;
+    int fd, count = 0;
+    if ((fd = open_proc_file(pid, "task")) < 0)
+        return -1;
+    if ((dir = fdopendir(fd)) == NULL)
+    {
+        close(fd);
+        return -1;
+    }
+    while (count < max && (d = readdir(dir)) != NULL)
+    {
+        struct proc_stat st;
+        ssize_t n;
+        if (d->d_name[0] < '0' || d->d_name[0] > '9' || strlen(d->d_name) > 10)
+            continue;
+        sprintf(path, "task/%s/stat", d->d_name);
+        /* a thread which exited meanwhile is skipped */
+        if ((n = read_proc_file(pid, path, buf, sizeof(buf), &syscall_count)) < 0 ||
+            parse_proc_stat(buf, (size_t)n, &st) != 0)
+            continue;
+        threads[count].tid = (pid_t)atol(d->d_name);
+        threads[count].cputime = (double)(st.utime + st.stime) * 1000.0 / (double)get_clk_tck();
+        count++;
+    }
+    closedir(dir);
+    return count;
+}
+
 pid_t getppid_of(pid_t pid)
 {
-    char statfile[32];
-    FILE *fd;
-    long ppid;
+    char buf[STAT_BUFSIZE];
+    struct proc_stat st;
+    ssize_t n;
     if (pid <= 0)
         return (pid_t)(-1);
-    sprintf(statfile, "/proc/%ld/stat", (long)pid);
-    if ((fd = fopen(statfile, "r")) == NULL)
+    if ((n = read_proc_file(pid, "stat", buf, sizeof(buf), &syscall_count)) < 0 ||
+        parse_proc_stat(buf, (size_t)n, &st) != 0)
         return (pid_t)(-1);
-    if (fscanf(fd, "%*d (%*[^)]) %*c %ld", &ppid) != 1)
-        ppid = -1;
-    fclose(fd);
-    return (pid_t)ppid;
+    return (pid_t)st.ppid;
 }
 
 static int get_start_time(pid_t pid, struct timespec *start_time)
@@ -169,75 +950,73 @@ int is_child_of(pid_t child_pid, pid_t parent_pid)
     return 0;
 }
 
-static int is_numeric(const char *str)
+int iterator_is_child_of(const struct process_iterator *it, pid_t child_pid, pid_t parent_pid)
 {
-    if (str == NULL || *str == '\0')
+    int child, parent, steps;
+    if (child_pid <= 1 || parent_pid <= 0 || child_pid == parent_pid)
         return 0;
-    for (; *str != '\0'; str++)
+    if (parent_pid == 1)
+        return 1;
+    parent = snapshot_find(&it->snap, parent_pid);
+    child = snapshot_find(&it->snap, child_pid);
+    if (parent < 0 || child < 0)
+        return is_child_of(child_pid, parent_pid);
+    for (steps = 0; child >= 0 && steps < it->snap.count; steps++)
     {
-        if (!isdigit(*str))
+        const struct proc_snapshot_entry *e = &it->snap.entries[child];
+        if (e->starttime < it->snap.entries[parent].starttime)
             return 0;
+        if (e->ppid == parent_pid)
+            return 1;
+        child = snapshot_find(&it->snap, e->ppid);
     }
-    return 1;
+    return 0;
 }
 
 int get_next_process(struct process_iterator *it, struct process *p)
 {
-    const struct dirent *dit = NULL;
-
-    if (it->dip == NULL)
-    {
-        /* end of processes */
-        return -1;
-    }
     if (it->filter->pid != 0 && !it->filter->include_children)
     {
-        int ret = read_process_info(it->filter->pid, p);
-        closedir(it->dip);
-        it->dip = NULL;
-        return ret == 0 ? 0 : -1;
+        if (it->i >= it->count)
+        {
+            /* end of processes */
+            return -1;
+        }
+        it->i = it->count;
+        return read_process_info(it, it->filter->pid, p) == 0 ? 0 : -1;
     }
 
-    /* read in from /proc and seek for process dirs */
-    while ((dit = readdir(it->dip)) != NULL)
+    while (it->i < it->count)
     {
-#ifdef _DIRENT_HAVE_D_TYPE
-        if (dit->d_type != DT_DIR)
-            continue;
-#endif
-        if (!is_numeric(dit->d_name) ||
-            (p->pid = (pid_t)atol(dit->d_name)) <= 0)
+        const struct proc_snapshot_entry *e = &it->snap.entries[it->i++];
+        if (!e->selected || is_zombie(e->state) || !comm_matches(e, it->filter->name))
             continue;
-        if (it->filter->pid != 0 &&
-            it->filter->pid != p->pid &&
-            !is_child_of(p->pid, it->filter->pid))
-            continue;
-        if (read_process_info(p->pid, p) != 0)
+        if (read_process_command(it, e, p) != 0)
             continue;
+        fill_process(e, p);
         return 0;
     }
     /* end of processes */
-    closedir(it->dip);
-    it->dip = NULL;
     return -1;
 }
 
 int close_process_iterator(struct process_iterator *it)
 {
-    int ret = 0;
     if (it == NULL)
         return -1; /* Invalid argument */
 
-    if (it->dip != NULL)
-    {
-        if ((ret = closedir(it->dip)) != 0)
-        {
-            perror("closedir");
-        }
-        it->dip = NULL;
-    }
+    free(it->snap.entries);
+    free(it->snap.child_first);
+    free(it->snap.children);
+    free(it->snap.queue);
+    free(it->snap.dents);
+    it->snap.entries = NULL;
+    it->snap.child_first = it->snap.children = it->snap.queue = NULL;
+    it->snap.count = it->snap.capacity = it->snap.index_capacity = 0;
+    it->snap.dents = NULL;
+    it->i = it->count = 0;
 
-    return ret == 0 ? 0 : -1;
+    return 0;
 }
 
 #endif
@@ -0,0 +1,296 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <fnmatch.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "hash_slots.h"
+#include "process_matcher.h"
+#include "util.h"
+
+/* Maximum load factor of the cache, in percent */
+#define MAX_LOAD 50
+
+/* Initial number of slots of the cache */
+#define INITIAL_SIZE 64
+
+/* Time in milliseconds after which a cached result is computed again, so
+   that a process executing another program without an event is noticed.
+   Each result lives between half of it and all of it depending on the PID,
+   so that the results computed together do not expire in the same scan */
+#define MATCH_CACHE_TTL 10000
+
+/* refresh the time at which the cached results are checked */
+static void update_time(struct process_matcher *m)
+{
+    struct timespec now;
+    if (get_time(&now))
+    {
+        exit(EXIT_FAILURE);
+    }
+    m->now = (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void alloc_slots(struct process_matcher *m, int size)
+{
+    m->size = size;
+    m->count = 0;
+    m->entries = (struct match_entry *)calloc((size_t)size, sizeof(struct match_entry));
+    if (m->entries == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed for the match cache\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* look for an executable file in the directories of PATH */
+static int stat_in_path(const char *name, struct stat *st)
+{
+    const char *dir = getenv("PATH"), *end;
+    char path[PATH_MAX];
+    for (; dir != NULL && *dir != '\0'; dir = *end == ':' ? end + 1 : end)
+    {
+        size_t len;
+        end = strchr(dir, ':');
+        if (end == NULL)
+            end = dir + strlen(dir);
+        len = (size_t)(end - dir);
+        if (len == 0 || len + strlen(name) + 2 > sizeof(path))
+            continue;
+        memcpy(path, dir, len);
+        path[len] = '/';
+        strcpy(path + len + 1, name);
+        if (stat(path, st) == 0 && S_ISREG(st->st_mode))
+            return 0;
+    }
+    return -1;
+}
+
+int process_matcher_init(struct process_matcher *m, int mode, const char *pattern)
+{
+    struct stat st;
+    m->mode = mode;
+    m->pattern = pattern;
+    m->name = basename(pattern);
+    m->full_path = strchr(pattern, '/') != NULL;
+    m->fields = PROCESS_FIELDS_STATUS;
+    m->hint = NULL;
+    switch (mode)
+    {
+    case MATCH_NAME:
+        /* the iterator reads the command lines of the candidates only */
+        m->fields |= PROCESS_FIELD_COMMAND;
+        m->hint = m->name;
+        break;
+    case MATCH_EXE:
+        if ((m->full_path ? stat(pattern, &st) : stat_in_path(pattern, &st)) != 0)
+            return -1;
+        m->dev = st.st_dev;
+        m->ino = st.st_ino;
+        break;
+    case MATCH_GLOB:
+        break;
+    case MATCH_REGEX:
+        if (regcomp(&m->regex, pattern, REG_EXTENDED | REG_NOSUB) != 0)
+            return -1;
+        break;
+    default:
+        return -1;
+    }
+    m->scans = 1;
+    m->events = 0;
+    update_time(m);
+    alloc_slots(m, INITIAL_SIZE);
+    return 0;
+}
+
+/* Fibonacci hashing spreads consecutive PIDs over the whole cache */
+static unsigned long pid_hash(pid_t pid)
+{
+    unsigned long h = (unsigned long)pid * 2654435769UL;
+    return h ^ (h >> 15);
+}
+
+static int pid_slot(const struct process_matcher *m, pid_t pid)
+{
+    return (int)(pid_hash(pid) & (unsigned long)(m->size - 1));
+}
+
+static int find_slot(const struct process_matcher *m, pid_t pid)
+{
+    int mask = m->size - 1;
+    int i = pid_slot(m, pid);
+    while (m->entries[i].pid != 0 && m->entries[i].pid != pid)
+        i = (i + 1) & mask;
+    return i;
+}
+
+/* home slot of the entry stored in a slot, -1 if it is empty */
+static int entry_home(const void *table, int slot)
+{
+    const struct process_matcher *m = (const struct process_matcher *)table;
+    return m->entries[slot].pid != 0 ? pid_slot(m, m->entries[slot].pid) : -1;
+}
+
+static void move_entry(void *table, int to, int from)
+{
+    struct process_matcher *m = (struct process_matcher *)table;
+    m->entries[to] = m->entries[from];
+}
+
+/* move the entries to new slots of the given size, dropping those unseen by the scan if asked */
+static void rehash(struct process_matcher *m, int size, int drop_unseen)
+{
+    struct match_entry *entries = m->entries;
+    int i, old_size = m->size;
+    alloc_slots(m, size);
+    for (i = 0; i < old_size; i++)
+    {
+        if (entries[i].pid != 0 && (!drop_unseen || entries[i].seen == m->scans))
+        {
+            m->entries[find_slot(m, entries[i].pid)] = entries[i];
+            m->count++;
+        }
+    }
+    free(entries);
+}
+
+/* compare the command of a process with the pattern */
+static int command_matches(const struct process_matcher *m, const char *command)
+{
+    const char *text = m->full_path ? command : basename(command);
+    switch (m->mode)
+    {
+    case MATCH_NAME:
+        return strncmp(basename(command), m->name, PATH_MAX) == 0;
+    case MATCH_GLOB:
+        return fnmatch(m->pattern, text, 0) == 0;
+    case MATCH_REGEX:
+        return regexec(&m->regex, text, 0, NULL, 0) == 0;
+    default:
+        return 0;
+    }
+}
+
+/* compute the result for a process. A process whose executable or command
+   cannot be read (kernel threads, exited processes) does not match, and
+   this is cached as well since the start time tells apart a new process */
+static int evaluate(const struct process_matcher *m, const struct process *p)
+{
+    struct process_iterator it;
+    struct process_filter filter;
+    struct process proc;
+    struct stat st;
+    int ret;
+    if (m->mode == MATCH_EXE)
+    {
+        if (stat_process_exe(p->pid, &st) != 0)
+            return 0;
+        return st.st_dev == m->dev && st.st_ino == m->ino;
+    }
+    if (p->command != NULL)
+        return command_matches(m, p->command);
+    filter.pid = p->pid;
+    filter.include_children = 0;
+    filter.known = NULL;
+    filter.fields = PROCESS_FIELDS_STATUS | PROCESS_FIELD_COMMAND;
+    filter.name = NULL;
+    filter.cgroup_fd = -1;
+    if (init_process_iterator(&it, &filter) != 0)
+        return 0;
+    ret = 0;
+    /* the PID may have been reused meanwhile */
+    if (get_next_process(&it, &proc) == 0 && proc.starttime == p->starttime)
+        ret = command_matches(m, proc.command);
+    close_process_iterator(&it);
+    return ret;
+}
+
+int process_matcher_match(struct process_matcher *m, const struct process *p)
+{
+    struct match_entry *e;
+    int i = find_slot(m, p->pid);
+    e = &m->entries[i];
+    if (e->pid == p->pid && e->starttime == p->starttime && e->result >= 0 &&
+        (m->events || m->now < e->expires))
+    {
+        e->seen = m->scans;
+        return e->result;
+    }
+    if (e->pid == 0)
+    {
+        if ((m->count + 1) * 100 > m->size * MAX_LOAD)
+        {
+            rehash(m, m->size * 2, 0);
+            i = find_slot(m, p->pid);
+        }
+        e = &m->entries[i];
+        e->pid = p->pid;
+        m->count++;
+    }
+    e->starttime = p->starttime;
+    e->result = (signed char)evaluate(m, p);
+    e->expires = m->now + MATCH_CACHE_TTL / 2 + (int64_t)(pid_hash(p->pid) % (MATCH_CACHE_TTL / 2));
+    e->seen = m->scans;
+    return e->result;
+}
+
+void process_matcher_forget(struct process_matcher *m, pid_t pid)
+{
+    struct match_entry *e = &m->entries[find_slot(m, pid)];
+    if (e->pid == pid)
+        e->result = -1;
+}
+
+void process_matcher_forget_all(struct process_matcher *m)
+{
+    int i;
+    for (i = 0; i < m->size; i++)
+        m->entries[i].result = -1;
+}
+
+void process_matcher_use_events(struct process_matcher *m)
+{
+    m->events = 1;
+}
+
+void process_matcher_end_scan(struct process_matcher *m)
+{
+    /* the exited processes are dropped, shrinking the cache if it became sparse */
+    int i, live = 0, size = m->size;
+    for (i = 0; i < m->size; i++)
+        live += m->entries[i].pid != 0 && m->entries[i].seen == m->scans;
+    while (size > INITIAL_SIZE && live * 100 < size * MAX_LOAD / 4)
+        size /= 2;
+    if (size < m->size)
+        rehash(m, size, 1);
+    else if (live < m->count)
+    {
+        /* the slot is checked again after a deletion, which may have filled it */
+        for (i = 0; i < m->size;)
+        {
+            if (m->entries[i].pid != 0 && m->entries[i].seen != m->scans)
+            {
+                int hole = hash_slots_delete(m, m->size, i, entry_home, move_entry);
+                memset(&m->entries[hole], 0, sizeof(struct match_entry));
+                m->count--;
+            }
+            else
+                i++;
+        }
+    }
+    m->scans++;
+    update_time(m);
+}
+
+void process_matcher_destroy(struct process_matcher *m)
+{
+    if (m->mode == MATCH_REGEX)
+        regfree(&m->regex);
+    free(m->entries);
+    m->entries = NULL;
+    m->size = m->count = 0;
+}
@@ -0,0 +1,149 @@
+#ifndef __PROCESS_MATCHER_H
+#define __PROCESS_MATCHER_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <regex.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "process_iterator.h"
+
+/* The base name of the command equals the base name of the pattern */
+#define MATCH_NAME 0
+
+/* The process runs the same executable file (device and inode) as the pattern */
+#define MATCH_EXE 1
+
+/* The command matches a shell wildcard pattern */
+#define MATCH_GLOB 2
+
+/* The command matches a POSIX extended regular expression */
+#define MATCH_REGEX 3
+
+/**
+ * Result of the matching of a process, identified by PID and start time.
+ */
+struct match_entry
+{
+    /* PID of the process, 0 for an empty slot */
+    pid_t pid;
+
+    /* 1 if the process matches, 0 if it does not, -1 if unknown */
+    signed char result;
+
+    /* Start time of the process, telling apart processes with the same PID */
+    int64_t starttime;
+
+    /* Time after which the result is computed again, in milliseconds */
+    int64_t expires;
+
+    /* Last scan which saw the process */
+    unsigned long seen;
+};
+
+/**
+ * Structure representing a compiled process name pattern, with a cache of
+ * the results for the processes already seen: open addressing with linear
+ * probing keyed by PID.
+ */
+struct process_matcher
+{
+    /* One of the MATCH_* values */
+    int mode;
+
+    /* Base name of the pattern */
+    const char *name;
+
+    /* Pattern applied to the full command (it contains a '/') or to its base name */
+    const char *pattern;
+    int full_path;
+
+    /* Executable file of MATCH_EXE */
+    dev_t dev;
+    ino_t ino;
+
+    /* Compiled expression of MATCH_REGEX */
+    regex_t regex;
+
+    /* Fields and name hint of the filter of the iterators scanning for matches */
+    int fields;
+    const char *hint;
+
+    /* Cache of the results */
+    struct match_entry *entries;
+    int size;
+    int count;
+
+    /* Number of scans completed */
+    unsigned long scans;
+
+    /* Time of the end of the last scan, in milliseconds */
+    int64_t now;
+
+    /* Whether the results are forgotten on process events instead of expiring */
+    int events;
+};
+
+/**
+ * Compiles a pattern. With MATCH_EXE, a pattern without '/' is looked up in PATH.
+ *
+ * @param m The matcher to initialize
+ * @param mode One of the MATCH_* values
+ * @param pattern The pattern, which must outlive the matcher
+ * @return 0 on success, -1 if the executable cannot be accessed or the
+ *         expression is invalid
+ */
+int process_matcher_init(struct process_matcher *m, int mode, const char *pattern);
+
+/**
+ * Tells whether a process matches, using the cached result if any.
+ * The command is read only if the process is not in the cache yet, or if
+ * its result expired.
+ *
+ * @param m The matcher
+ * @param p The process, with at least its PID and start time. Its command
+ *          is used if it is not NULL
+ * @return 1 if the process matches, 0 otherwise
+ */
+int process_matcher_match(struct process_matcher *m, const struct process *p);
+
+/**
+ * Forgets the cached result of a process, which has executed another program.
+ *
+ * @param m The matcher
+ * @param pid The PID of the process
+ */
+void process_matcher_forget(struct process_matcher *m, pid_t pid);
+
+/**
+ * Forgets all the cached results, after process events have been lost.
+ *
+ * @param m The matcher
+ */
+void process_matcher_forget_all(struct process_matcher *m);
+
+/**
+ * Keeps the cached results until they are forgotten: every process executing
+ * another program is then reported by an event.
+ *
+ * @param m The matcher
+ */
+void process_matcher_use_events(struct process_matcher *m);
+
+/**
+ * Ends a scan of all the processes, forgetting those which were not seen.
+ *
+ * @param m The matcher
+ */
+void process_matcher_end_scan(struct process_matcher *m);
+
+/**
+ * Frees the compiled pattern and the cache.
+ *
+ * @param m The matcher
+ */
+void process_matcher_destroy(struct process_matcher *m);
+
+#endif
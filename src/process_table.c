@@ -6,96 +6,132 @@
 #include <string.h>
 #include <sys/types.h>
 #include <stdio.h>
+#include "hash_slots.h"
 #include "process_table.h"
 
-void process_table_init(struct process_table *pt, int hashsize)
+/* Maximum load factor of the table, in percent */
+#define MAX_LOAD 50
+
+static void alloc_slots(struct process_table *pt, int hashsize)
 {
     pt->hashsize = hashsize;
-    pt->table = (struct list **)calloc((size_t)pt->hashsize, sizeof(struct list *));
-    if (pt->table == NULL)
+    pt->count = 0;
+    pt->keys = (pid_t *)calloc((size_t)hashsize, sizeof(pid_t));
+    pt->values = (struct process **)calloc((size_t)hashsize, sizeof(struct process *));
+    if (pt->keys == NULL || pt->values == NULL)
     {
         fprintf(stderr, "Memory allocation failed for the process table\n");
         exit(EXIT_FAILURE);
     }
 }
 
-static int proc_hash(const struct process_table *pt, const struct process *p)
+void process_table_init(struct process_table *pt, int hashsize)
 {
-    return p->pid % pt->hashsize;
+    int size = 16;
+    while (size < hashsize)
+        size *= 2;
+    alloc_slots(pt, size);
 }
 
-struct process *process_table_find(const struct process_table *pt, const struct process *p)
+/* Fibonacci hashing spreads consecutive PIDs over the whole table */
+static int pid_slot(const struct process_table *pt, pid_t pid)
+{
+    unsigned long h = (unsigned long)pid * 2654435769UL;
+    return (int)((h ^ (h >> 15)) & (unsigned long)(pt->hashsize - 1));
+}
+
+/* return the slot holding pid, or the empty slot where it would be inserted */
+static int find_slot(const struct process_table *pt, pid_t pid)
+{
+    int mask = pt->hashsize - 1;
+    int i = pid_slot(pt, pid);
+    while (pt->keys[i] != 0 && pt->keys[i] != pid)
+        i = (i + 1) & mask;
+    return i;
+}
+
+/* home slot of the entry stored in a slot, -1 if it is empty */
+static int entry_home(const void *table, int slot)
+{
+    const struct process_table *pt = (const struct process_table *)table;
+    return pt->keys[slot] != 0 ? pid_slot(pt, pt->keys[slot]) : -1;
+}
+
+static void move_entry(void *table, int to, int from)
+{
+    struct process_table *pt = (struct process_table *)table;
+    pt->keys[to] = pt->keys[from];
+    pt->values[to] = pt->values[from];
+}
+
+static void grow(struct process_table *pt)
 {
-    int idx = proc_hash(pt, p);
-    if (pt->table[idx] == NULL)
+    pid_t *keys = pt->keys;
+    struct process **values = pt->values;
+    int i, hashsize = pt->hashsize;
+    alloc_slots(pt, hashsize * 2);
+    for (i = 0; i < hashsize; i++)
     {
-        return NULL;
+        if (keys[i] != 0)
+        {
+            int j = find_slot(pt, keys[i]);
+            pt->keys[j] = keys[i];
+            pt->values[j] = values[i];
+            pt->count++;
+        }
     }
-    return (struct process *)locate_elem(pt->table[idx], p);
+    free(keys);
+    free(values);
+}
+
+struct process *process_table_find(const struct process_table *pt, const struct process *p)
+{
+    return process_table_find_pid(pt, p->pid);
 }
 
 struct process *process_table_find_pid(const struct process_table *pt, pid_t pid)
 {
-    struct process *p, *res;
-    p = (struct process *)malloc(sizeof(struct process));
-    if (p == NULL)
-    {
-        fprintf(stderr, "Memory allocation failed for the process\n");
-        exit(EXIT_FAILURE);
-    }
-    p->pid = pid;
-    res = process_table_find(pt, p);
-    free(p);
-    return res;
+    int i;
+    if (pid <= 0)
+        return NULL;
+    i = find_slot(pt, pid);
+    return pt->keys[i] == pid ? pt->values[i] : NULL;
 }
 
 void process_table_add(struct process_table *pt, struct process *p)
 {
-    int idx = proc_hash(pt, p);
-    if (pt->table[idx] == NULL)
+    int i;
+    if (p->pid <= 0)
+        return;
+    if ((pt->count + 1) * 100 > pt->hashsize * MAX_LOAD)
+        grow(pt);
+    i = find_slot(pt, p->pid);
+    if (pt->keys[i] == 0)
     {
-        pt->table[idx] = (struct list *)malloc(sizeof(struct list));
-        if (pt->table[idx] == NULL)
-        {
-            fprintf(stderr, "Memory allocation failed for the process list\n");
-            exit(EXIT_FAILURE);
-        }
-        init_list(pt->table[idx], sizeof(pid_t));
+        pt->keys[i] = p->pid;
+        pt->count++;
     }
-    add_elem(pt->table[idx], p);
+    pt->values[i] = p;
 }
 
 int process_table_del(struct process_table *pt, const struct process *p)
 {
-    struct list_node *node;
-    int idx = proc_hash(pt, p);
-    if (pt->table[idx] == NULL)
-    {
-        return 1; /* nothing to delete */
-    }
-    node = (struct list_node *)locate_node(pt->table[idx], p);
-    if (node == NULL)
-    {
-        return 1; /* nothing to delete */
-    }
-    delete_node(pt->table[idx], node);
-    return 0;
+    return process_table_del_pid(pt, p->pid);
 }
 
 int process_table_del_pid(struct process_table *pt, pid_t pid)
 {
-    struct process *p;
-    int ret;
-    p = (struct process *)malloc(sizeof(struct process));
-    if (p == NULL)
-    {
-        fprintf(stderr, "Memory allocation failed for the process\n");
-        exit(EXIT_FAILURE);
-    }
-    p->pid = pid;
-    ret = process_table_del(pt, p);
-    free(p);
-    return ret;
+    int i;
+    if (pid <= 0)
+        return 1; /* nothing to delete */
+    i = find_slot(pt, pid);
+    if (pt->keys[i] == 0)
+        return 1; /* nothing to delete */
+    i = hash_slots_delete(pt, pt->hashsize, i, entry_home, move_entry);
+    pt->keys[i] = 0;
+    pt->values[i] = NULL;
+    pt->count--;
+    return 0;
 }
 
 void process_table_destroy(struct process_table *pt)
@@ -103,12 +139,12 @@ void process_table_destroy(struct process_table *pt)
     int i;
     for (i = 0; i < pt->hashsize; i++)
     {
-        if (pt->table[i] != NULL)
-        {
-            destroy_list(pt->table[i]);
-            free(pt->table[i]);
-        }
+        if (pt->keys[i] != 0)
+            free(pt->values[i]);
     }
-    free(pt->table);
-    pt->table = NULL;
+    free(pt->keys);
+    free(pt->values);
+    pt->keys = NULL;
+    pt->values = NULL;
+    pt->count = 0;
 }
@@ -7,25 +7,32 @@
 
 #include <sys/types.h>
 #include "process_iterator.h"
-#include "list.h"
 
 /**
- * Structure representing a process table.
+ * Structure representing a process table: an open addressing hash map
+ * from PID to process, with linear probing.
  */
 struct process_table
 {
-    /* Array of pointers to linked lists for storing processes */
-    struct list **table;
+    /* PID stored in each slot, 0 for an empty slot */
+    pid_t *keys;
 
-    /* Size of the hash table for the process table */
+    /* Process stored in each slot */
+    struct process **values;
+
+    /* Number of slots, a power of two */
     int hashsize;
+
+    /* Number of processes in the table */
+    int count;
 };
 
 /**
  * Initializes the process table with the given hash size.
+ * The table grows automatically as processes are added.
  *
  * @param pt The process table to initialize
- * @param hashsize The size of the hash table
+ * @param hashsize The initial size of the hash table
  */
 void process_table_init(struct process_table *pt, int hashsize);
 
@@ -48,7 +55,8 @@ struct process *process_table_find(const struct process_table *pt, const struct
 struct process *process_table_find_pid(const struct process_table *pt, pid_t pid);
 
 /**
- * Adds a process to the process table.
+ * Adds a process to the process table, replacing the process
+ * with the same PID if any.
  *
  * @param pt The process table to add the process to
  * @param p The process to add
@@ -74,7 +82,8 @@ int process_table_del(struct process_table *pt, const struct process *p);
 int process_table_del_pid(struct process_table *pt, pid_t pid);
 
 /**
- * Destroys the process table and frees up the memory.
+ * Destroys the process table and frees up the memory,
+ * including the processes it contains.
  *
  * @param pt The process table to destroy
  */
@@ -0,0 +1,148 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "hash_slots.h"
+#include "string_pool.h"
+
+/* Maximum load factor of the pool, in percent */
+#define MAX_LOAD 50
+
+/* Initial number of slots of the pool */
+#define INITIAL_SIZE 16
+
+static void alloc_slots(struct string_pool *pool, int size)
+{
+    pool->size = size;
+    pool->count = 0;
+    pool->strings = (char **)calloc((size_t)size, sizeof(char *));
+    pool->hashes = (unsigned long *)calloc((size_t)size, sizeof(unsigned long));
+    pool->refs = (int *)calloc((size_t)size, sizeof(int));
+    if (pool->strings == NULL || pool->hashes == NULL || pool->refs == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed for the string pool\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void string_pool_init(struct string_pool *pool)
+{
+    alloc_slots(pool, INITIAL_SIZE);
+}
+
+/* FNV-1a hash of a string */
+static unsigned long hash_string(const char *str)
+{
+    unsigned long h = 2166136261UL;
+    for (; *str != '\0'; str++)
+    {
+        h ^= (unsigned char)*str;
+        h = (h * 16777619UL) & 0xffffffffUL;
+    }
+    return h;
+}
+
+/* return the slot holding str, or the empty slot where it would be inserted */
+static int find_slot(const struct string_pool *pool, const char *str, unsigned long hash)
+{
+    int mask = pool->size - 1;
+    int i = (int)(hash & (unsigned long)mask);
+    while (pool->strings[i] != NULL &&
+           (pool->hashes[i] != hash || strcmp(pool->strings[i], str) != 0))
+        i = (i + 1) & mask;
+    return i;
+}
+
+/* home slot of the string stored in a slot, -1 if it is empty */
+static int entry_home(const void *table, int slot)
+{
+    const struct string_pool *pool = (const struct string_pool *)table;
+    return pool->strings[slot] != NULL ? (int)(pool->hashes[slot] & (unsigned long)(pool->size - 1)) : -1;
+}
+
+static void move_entry(void *table, int to, int from)
+{
+    struct string_pool *pool = (struct string_pool *)table;
+    pool->strings[to] = pool->strings[from];
+    pool->hashes[to] = pool->hashes[from];
+    pool->refs[to] = pool->refs[from];
+}
+
+static void grow(struct string_pool *pool)
+{
+    char **strings = pool->strings;
+    unsigned long *hashes = pool->hashes;
+    int *refs = pool->refs;
+    int i, size = pool->size;
+    alloc_slots(pool, size * 2);
+    for (i = 0; i < size; i++)
+    {
+        if (strings[i] != NULL)
+        {
+            int j = find_slot(pool, strings[i], hashes[i]);
+            pool->strings[j] = strings[i];
+            pool->hashes[j] = hashes[i];
+            pool->refs[j] = refs[i];
+            pool->count++;
+        }
+    }
+    free(strings);
+    free(hashes);
+    free(refs);
+}
+
+const char *string_pool_intern(struct string_pool *pool, const char *str)
+{
+    unsigned long hash = hash_string(str);
+    int i;
+    if ((pool->count + 1) * 100 > pool->size * MAX_LOAD)
+        grow(pool);
+    i = find_slot(pool, str, hash);
+    if (pool->strings[i] == NULL)
+    {
+        size_t len = strlen(str) + 1;
+        if ((pool->strings[i] = (char *)malloc(len)) == NULL)
+        {
+            fprintf(stderr, "Memory allocation failed for the interned string\n");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(pool->strings[i], str, len);
+        pool->hashes[i] = hash;
+        pool->refs[i] = 0;
+        pool->count++;
+    }
+    pool->refs[i]++;
+    return pool->strings[i];
+}
+
+void string_pool_release(struct string_pool *pool, const char *str)
+{
+    int i;
+    if (str == NULL)
+        return;
+    i = find_slot(pool, str, hash_string(str));
+    if (pool->strings[i] == NULL || --pool->refs[i] > 0)
+        return;
+    free(pool->strings[i]);
+    i = hash_slots_delete(pool, pool->size, i, entry_home, move_entry);
+    pool->strings[i] = NULL;
+    pool->refs[i] = 0;
+    pool->count--;
+}
+
+void string_pool_destroy(struct string_pool *pool)
+{
+    int i;
+    for (i = 0; i < pool->size; i++)
+        free(pool->strings[i]);
+    free(pool->strings);
+    free(pool->hashes);
+    free(pool->refs);
+    pool->strings = NULL;
+    pool->hashes = NULL;
+    pool->refs = NULL;
+    pool->count = 0;
+}
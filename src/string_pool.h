@@ -0,0 +1,66 @@
+#ifndef __STRING_POOL_H
+#define __STRING_POOL_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+/**
+ * Structure representing a pool of interned strings: an open addressing
+ * hash set with linear probing, in which each distinct string is stored
+ * once and reference counted.
+ */
+struct string_pool
+{
+    /* String stored in each slot, NULL for an empty slot */
+    char **strings;
+
+    /* Hash of the string stored in each slot */
+    unsigned long *hashes;
+
+    /* Number of references to the string stored in each slot */
+    int *refs;
+
+    /* Number of slots, a power of two */
+    int size;
+
+    /* Number of distinct strings in the pool */
+    int count;
+};
+
+/**
+ * Initializes an empty string pool.
+ * The pool grows automatically as strings are added.
+ *
+ * @param pool The string pool to initialize
+ */
+void string_pool_init(struct string_pool *pool);
+
+/**
+ * Returns the copy of a string held by the pool, adding it if needed,
+ * and takes a reference to it.
+ *
+ * @param pool The string pool
+ * @param str The string to intern
+ * @return The interned copy of the string, valid until the reference is
+ *         released with string_pool_release()
+ */
+const char *string_pool_intern(struct string_pool *pool, const char *str);
+
+/**
+ * Releases a reference to an interned string, which is freed along
+ * with its last reference.
+ *
+ * @param pool The string pool
+ * @param str The string returned by string_pool_intern(), or NULL
+ */
+void string_pool_release(struct string_pool *pool, const char *str);
+
+/**
+ * Destroys the string pool and frees all the strings it contains.
+ *
+ * @param pool The string pool to destroy
+ */
+void string_pool_destroy(struct string_pool *pool);
+
+#endif
@@ -11,6 +11,8 @@
 #endif
 #include "util.h"
 
+unsigned long syscall_count = 0;
+
 #ifdef __IMPL_BASENAME
 const char *__basename(const char *path)
 {
@@ -46,6 +48,17 @@ void increase_priority(void)
     }
 }
 
+/* Raise the limit of open files, so that large groups keep their descriptors */
+void raise_fd_limit(void)
+{
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max)
+    {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
 /* Get the number of CPUs */
 int get_ncpu(void)
 {
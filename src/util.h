@@ -160,11 +160,22 @@ int __get_time(struct timespec *ts);
     ((double)((t1)->tv_sec - (t2)->tv_sec) * 1e3 + (double)((t1)->tv_nsec - (t2)->tv_nsec) / 1e6)
 #endif
 
+/**
+ * Number of system calls issued to sample and control the processes,
+ * reported in verbose mode
+ */
+extern unsigned long syscall_count;
+
 /**
  * Increases the priority of the current process
  */
 void increase_priority(void);
 
+/**
+ * Raises the soft limit of open file descriptors up to the hard limit
+ */
+void raise_fd_limit(void);
+
 /**
  * Retrieves the number of available CPUs
  */
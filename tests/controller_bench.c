@@ -0,0 +1,193 @@
+/**
+ *
+ * cpulimit - a CPU limiter for Linux
+ *
+ * Copyright (C) 2005-2012, by:  Angelo Marletta <angelo dot marletta at gmail dot com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Closed loop benchmark of the adjustment of the working rate: for each
+ * controller, tests/busy runs with 1, 2, 4 and 8 threads under cpulimit, its
+ * CPU usage is sampled every 100 ms over two second windows, and the
+ * settling time, the overshoot and the steady state error are reported.
+ *
+ * Usage: controller_bench [LIMIT [SECONDS [BUSY [CPULIMIT]]]]
+ * (default 50 percent for 20 seconds, ./busy and ../src/cpulimit)
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../src/util.h"
+
+/* Interval between two samples (in milliseconds) */
+#define SAMPLE_MS 100
+
+/* Number of samples of the window the CPU usage is measured over, which
+   spans several periods of the time slot even when it grows with the load */
+#define WINDOW 20
+
+/* Band around the limit the usage settles in (in percent of the limit),
+   wide enough for the ripple of the slots measured by the window */
+#define SETTLE_BAND 20
+
+/* run a program, with its standard output discarded if quiet is set */
+static pid_t spawn(char *const argv[], int quiet)
+{
+    pid_t pid;
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0)
+    {
+        if (quiet && freopen("/dev/null", "w", stdout) == NULL)
+            _exit(EXIT_FAILURE);
+        execv(argv[0], argv);
+        perror(argv[0]);
+        _exit(EXIT_FAILURE);
+    }
+    return pid;
+}
+
+/* return the CPU time of a process in clock ticks, or -1 */
+static long read_cpu_time(pid_t pid)
+{
+    char path[64], buf[1024], *p;
+    unsigned long utime, stime;
+    FILE *f;
+    size_t n;
+    sprintf(path, "/proc/%ld/stat", (long)pid);
+    if ((f = fopen(path, "r")) == NULL)
+        return -1;
+    n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+    /* the fields after the command, which may contain spaces */
+    if ((p = strrchr(buf, ')')) == NULL ||
+        sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+               &utime, &stime) != 2)
+        return -1;
+    return (long)(utime + stime);
+}
+
+static void run(char *busy, char *cpulimit, const char *mode,
+                int threads, double limit, int seconds)
+{
+    char nthreads[16], pid_arg[32], limit_arg[32], mode_arg[32];
+    char *busy_argv[3], *cpulimit_argv[5];
+    int samples = seconds * 1000 / SAMPLE_MS, i, settled = -1;
+    long *cpu = (long *)malloc((size_t)(samples + 1) * sizeof(long));
+    struct timespec *when = (struct timespec *)malloc((size_t)(samples + 1) * sizeof(struct timespec));
+    double hz = (double)sysconf(_SC_CLK_TCK), peak = 0, sum = 0;
+    int tail = 0;
+    struct timespec interval;
+    pid_t busy_pid, cpulimit_pid;
+    if (cpu == NULL || when == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed for the samples\n");
+        exit(EXIT_FAILURE);
+    }
+    sprintf(nthreads, "%d", threads);
+    busy_argv[0] = busy;
+    busy_argv[1] = nthreads;
+    busy_argv[2] = NULL;
+    busy_pid = spawn(busy_argv, 0);
+    sprintf(pid_arg, "--pid=%ld", (long)busy_pid);
+    sprintf(limit_arg, "--limit=%g", limit);
+    sprintf(mode_arg, "--controller=%s", mode);
+    cpulimit_argv[0] = cpulimit;
+    cpulimit_argv[1] = pid_arg;
+    cpulimit_argv[2] = limit_arg;
+    cpulimit_argv[3] = mode_arg;
+    cpulimit_argv[4] = NULL;
+    cpulimit_pid = spawn(cpulimit_argv, 1);
+
+    interval.tv_sec = 0;
+    interval.tv_nsec = SAMPLE_MS * 1000000L;
+    for (i = 0; i <= samples; i++)
+    {
+        if (i > 0)
+            sleep_timespec(&interval);
+        cpu[i] = read_cpu_time(busy_pid);
+        /* the samples are late when the CPUs are busy, so they are timed */
+        if (get_time(&when[i]))
+        {
+            exit(EXIT_FAILURE);
+        }
+    }
+    kill(cpulimit_pid, SIGTERM);
+    waitpid(cpulimit_pid, NULL, 0);
+    kill(busy_pid, SIGKILL);
+    waitpid(busy_pid, NULL, 0);
+
+    /* usage over the window ending at each sample, in percent of a CPU */
+    for (i = WINDOW; i <= samples; i++)
+    {
+        double usage = (double)(cpu[i] - cpu[i - WINDOW]) / hz * 100 * 1000 /
+                       timediff_in_ms(&when[i], &when[i - WINDOW]);
+        /* the samples near the end show the steady state */
+        if (usage > limit * (100 + SETTLE_BAND) / 100 || usage < limit * (100 - SETTLE_BAND) / 100)
+            settled = -1;
+        else if (settled < 0)
+            settled = i;
+        peak = MAX(peak, usage);
+        if (i > samples - samples / 3)
+        {
+            sum += usage;
+            tail++;
+        }
+    }
+    printf("%-6s %7d ", mode, threads);
+    if (settled < 0)
+        printf("%11s ", "never");
+    else
+        printf("%10.1fs ", timediff_in_ms(&when[settled], &when[0]) / 1000);
+    printf("%9.1f%% %+10.1f%%\n", MAX(peak - limit, 0.0), tail > 0 ? sum / tail - limit : 0.0);
+    free(cpu);
+    free(when);
+}
+
+int main(int argc, char *argv[])
+{
+    static const char *modes[] = {"ratio", "pi"};
+    static const int threads[] = {1, 2, 4, 8};
+    double limit = argc > 1 ? atof(argv[1]) : 50;
+    int seconds = argc > 2 ? atoi(argv[2]) : 20;
+    char *busy = argc > 3 ? argv[3] : "./busy";
+    char *cpulimit = argc > 4 ? argv[4] : "../src/cpulimit";
+    size_t i, j;
+    if (limit <= 0 || seconds * 1000 <= WINDOW * SAMPLE_MS)
+    {
+        fprintf(stderr, "Usage: %s [LIMIT [SECONDS [BUSY [CPULIMIT]]]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    /* sample on time despite the busy threads */
+    increase_priority();
+    printf("limit: %g%%, %d s per run\n", limit, seconds);
+    printf("%-6s %7s %11s %10s %11s\n", "mode", "threads", "settling", "overshoot", "ss error");
+    for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++)
+        for (j = 0; j < sizeof(threads) / sizeof(threads[0]); j++)
+            run(busy, cpulimit, modes[i], threads[j], limit, seconds);
+    return 0;
+}
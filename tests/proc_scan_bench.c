@@ -0,0 +1,124 @@
+/**
+ *
+ * cpulimit - a CPU limiter for Linux
+ *
+ * Copyright (C) 2005-2012, by:  Angelo Marletta <angelo dot marletta at gmail dot com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Benchmark of the snapshot of /proc taken by the iterator (listing and
+ * reading /proc/<pid>/stat of every process) with 1, 2, 4 and 8 threads.
+ * Idle children are forked first so that the process table is large
+ * enough for the threads to be used (default 8000, see the argument).
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../src/process_iterator.h"
+#include "../src/util.h"
+
+/* Number of scans timed for each thread count */
+#define SCANS 20
+
+static pid_t *children;
+static int child_count = 0;
+
+static void spawn_children(int n)
+{
+    children = (pid_t *)malloc((size_t)n * sizeof(pid_t));
+    if (children == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed for the children\n");
+        exit(EXIT_FAILURE);
+    }
+    while (child_count < n)
+    {
+        pid_t pid = fork();
+        if (pid < 0)
+            break;
+        if (pid == 0)
+        {
+            pause();
+            _exit(EXIT_SUCCESS);
+        }
+        children[child_count++] = pid;
+    }
+}
+
+static void kill_children(void)
+{
+    int i;
+    for (i = 0; i < child_count; i++)
+        kill(children[i], SIGKILL);
+    for (i = 0; i < child_count; i++)
+        waitpid(children[i], NULL, 0);
+    free(children);
+}
+
+/* return the average time of a snapshot in milliseconds, and the processes read */
+static double bench(int threads, int *seen)
+{
+    struct process_iterator it;
+    struct process_filter filter;
+    struct timespec start, end;
+    int i;
+    filter.pid = 0;
+    filter.include_children = 0;
+    filter.known = NULL;
+    filter.fields = PROCESS_FIELDS_STATUS;
+    filter.name = NULL;
+    filter.cgroup_fd = -1;
+    set_scan_threads(threads);
+    /* the first snapshot allocates the buffers */
+    init_process_iterator(&it, &filter);
+    get_time(&start);
+    for (i = 0; i < SCANS; i++)
+        reinit_process_iterator(&it, &filter);
+    get_time(&end);
+    *seen = it.count;
+    close_process_iterator(&it);
+    return timediff_in_ms(&end, &start) / SCANS;
+}
+
+int main(int argc, char *argv[])
+{
+    static const int threads[] = {1, 2, 4, 8};
+    double base = 0.0;
+    size_t i;
+    spawn_children(argc > 1 ? atoi(argv[1]) : 8000);
+    printf("children: %d\n", child_count);
+    for (i = 0; i < sizeof(threads) / sizeof(threads[0]); i++)
+    {
+        int seen;
+        double t = bench(threads[i], &seen);
+        if (i == 0)
+            base = t;
+        printf("%d thread(s): %8.2f ms/snapshot, %d processes, speedup %.2fx\n",
+               threads[i], t, seen, base / t);
+    }
+    kill_children();
+    return 0;
+}
@@ -0,0 +1,201 @@
+/**
+ *
+ * cpulimit - a CPU limiter for Linux
+ *
+ * Copyright (C) 2005-2012, by:  Angelo Marletta <angelo dot marletta at gmail dot com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Microbenchmark of parse_proc_stat() against the scanf format previously
+ * used to read /proc/<pid>/stat, over a corpus of captured stat lines and
+ * of the stat files of the processes currently running.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/process_iterator.h"
+#include "../src/util.h"
+
+#ifdef __linux__
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Maximum number of lines in the corpus */
+#define MAX_LINES 4096
+
+/* Number of lines parsed by each benchmark */
+#define TOTAL_PARSES 2000000
+
+/* Lines captured from /proc/<pid>/stat, including command names that defeat %[^)] */
+static const char *const captured[] = {
+    "1 (systemd) S 0 1 1 0 -1 4194560 103518 4917863 110 3251 1209 1742 16316 9520 20 0 1 0 3 172408832 3231 18446744073709551615 1 1 0 0 0 0 671173123 4096 1260 0 0 0 17 2 0 0 0 0 0 0 0 0 0 0 0 0 0\n",
+    "2 (kthreadd) S 0 0 0 0 -1 2129984 0 0 0 0 0 7 0 0 20 0 1 0 3 0 0 18446744073709551615 0 0 0 0 0 0 0 2147483647 0 0 0 0 17 0 0 0 0 0 0 0 0 0 0 0 0 0 0\n",
+    "14 (kworker/0:1-events) I 2 0 0 0 -1 69238880 0 0 0 0 0 1853 0 0 20 0 1 0 4 0 0 18446744073709551615 0 0 0 0 0 0 0 2147483647 0 0 0 0 17 0 0 0 0 0 0 0 0 0 0 0 0 0 0\n",
+    "912 (sd-pam) S 911 911 911 0 -1 1077936448 59 0 0 0 0 0 0 0 20 0 1 0 1402 174288896 1130 18446744073709551615 1 1 0 0 0 0 0 4096 0 0 0 0 17 3 0 0 0 0 0 0 0 0 0 0 0 0 0\n",
+    "2203 (tmux: server) S 1 2203 2203 0 -1 4194368 4021 0 0 0 2817 3520 0 0 20 0 1 0 6120 12693504 1172 18446744073709551615 94712537923584 94712538425937 140736322187120 0 0 0 0 3674112 134433283 0 0 0 17 1 0 0 0 0 0 94712538571504 94712538603440 94712567615488 140736322195349 140736322195355 140736322195355 140736322195435 0\n",
+    "3380 (Web Content) S 3201 3201 3201 0 -1 4194560 812390 0 1 0 1931205 210338 0 0 20 0 31 0 98341 3224567808 98203 18446744073709551615 94279121694720 94279122335552 140724640612912 0 0 0 0 69634 1082131704 0 0 0 17 6 0 0 37 0 0 94279122343232 94279122343288 94279149240320 140724640619812 140724640619943 140724640619943 140724640620511 0\n",
+    "5120 (a) b) R 5101 5120 5101 34816 5120 4194304 110 0 0 0 12 3 0 0 20 0 1 0 441290 2703360 313 18446744073709551615 94706561155072 94706561174953 140723873412544 0 0 0 0 0 0 0 0 0 17 0 0 0 0 0 0 94706561190960 94706561192576 94707069714432 140723873420601 140723873420621 140723873420621 140723873423339 0\n",
+    "7001 (x (y) z) S 1 7001 7001 0 -1 4194560 7 0 0 0 42 17 0 0 20 0 2 0 562211 6332416 702 18446744073709551615 1 1 0 0 0 0 0 4096 0 0 0 0 17 1 0 0 0 0 0 0 0 0 0 0 0 0 0\n",
+    "31337 (make) S 31300 31337 30120 34817 31337 4194304 50817 3817502 0 12 221 97 893211 210774 20 0 1 0 1289400 9158656 1021 18446744073709551615 94221460094976 94221460295401 140729151210288 0 0 0 0 0 65538 1 0 0 17 5 0 0 0 0 0 94221460355472 94221460367232 94221478981632 140729151219012 140729151219038 140729151219038 140729151221227 0\n",
+};
+
+static char *corpus[MAX_LINES];
+static size_t corpus_len[MAX_LINES];
+static int corpus_count = 0;
+
+static void add_line(const char *line, size_t len)
+{
+    if (corpus_count >= MAX_LINES)
+        return;
+    corpus[corpus_count] = (char *)malloc(len + 1);
+    if (corpus[corpus_count] == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed for the corpus\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(corpus[corpus_count], line, len);
+    corpus[corpus_count][len] = '\0';
+    corpus_len[corpus_count++] = len;
+}
+
+static void load_corpus(void)
+{
+    DIR *dip;
+    const struct dirent *dit;
+    size_t i;
+    for (i = 0; i < sizeof(captured) / sizeof(captured[0]); i++)
+        add_line(captured[i], strlen(captured[i]));
+    if ((dip = opendir("/proc")) == NULL)
+        return;
+    while ((dit = readdir(dip)) != NULL)
+    {
+        char path[300], buf[1024];
+        ssize_t n;
+        int fd;
+        if (dit->d_name[0] < '0' || dit->d_name[0] > '9')
+            continue;
+        sprintf(path, "/proc/%s/stat", dit->d_name);
+        if ((fd = open(path, O_RDONLY)) < 0)
+            continue;
+        n = read(fd, buf, sizeof(buf));
+        close(fd);
+        if (n > 0)
+            add_line(buf, (size_t)n);
+    }
+    closedir(dip);
+}
+
+/* the scanf format used to parse /proc/<pid>/stat before parse_proc_stat() */
+static int scanf_proc_stat(const char *line, struct proc_stat *st)
+{
+    long ppid, pgrp, session, num_threads;
+    double utime, stime, cutime, cstime;
+    unsigned long starttime;
+    if (sscanf(line, "%*d (%*[^)]) %c %ld %ld %ld %*d %*d %*d %*d %*d %*d %*d "
+                     "%lf %lf %lf %lf %*d %*d %ld %*d %lu",
+               &st->state, &ppid, &pgrp, &session, &utime, &stime,
+               &cutime, &cstime, &num_threads, &starttime) != 10)
+        return -1;
+    st->ppid = ppid;
+    st->pgrp = pgrp;
+    st->session = session;
+    st->utime = (int64_t)utime;
+    st->stime = (int64_t)stime;
+    st->cutime = (int64_t)cutime;
+    st->cstime = (int64_t)cstime;
+    st->num_threads = num_threads;
+    st->starttime = (int64_t)starttime;
+    return 0;
+}
+
+static int same_stat(const struct proc_stat *a, const struct proc_stat *b)
+{
+    return a->state == b->state && a->ppid == b->ppid &&
+           a->pgrp == b->pgrp && a->session == b->session &&
+           a->utime == b->utime && a->stime == b->stime &&
+           a->cutime == b->cutime && a->cstime == b->cstime &&
+           a->num_threads == b->num_threads && a->starttime == b->starttime;
+}
+
+/* return the average time per line in nanoseconds */
+static double bench(int use_scanf)
+{
+    struct timespec start, end;
+    struct proc_stat st;
+    volatile int64_t sink = 0;
+    int i, rounds = TOTAL_PARSES / corpus_count + 1;
+    get_time(&start);
+    while (rounds-- > 0)
+    {
+        for (i = 0; i < corpus_count; i++)
+        {
+            int ret = use_scanf ? scanf_proc_stat(corpus[i], &st)
+                                : parse_proc_stat(corpus[i], corpus_len[i], &st);
+            if (ret == 0)
+                sink += st.utime + st.starttime;
+        }
+    }
+    get_time(&end);
+    (void)sink;
+    return timediff_in_ms(&end, &start) * 1e6 /
+           ((double)(TOTAL_PARSES / corpus_count + 1) * corpus_count);
+}
+
+int main(void)
+{
+    int i, mismatches = 0, failures = 0;
+    double t_scanf, t_parse;
+    load_corpus();
+    for (i = 0; i < corpus_count; i++)
+    {
+        struct proc_stat a, b;
+        if (parse_proc_stat(corpus[i], corpus_len[i], &a) != 0)
+            failures++;
+        else if (scanf_proc_stat(corpus[i], &b) != 0 || !same_stat(&a, &b))
+            mismatches++;
+    }
+    t_scanf = bench(1);
+    t_parse = bench(0);
+    printf("corpus: %d lines (%d captured)\n", corpus_count,
+           (int)(sizeof(captured) / sizeof(captured[0])));
+    printf("parse_proc_stat failures: %d\n", failures);
+    printf("lines misparsed by scanf: %d\n", mismatches);
+    printf("scanf:           %8.1f ns/line\n", t_scanf);
+    printf("parse_proc_stat: %8.1f ns/line\n", t_parse);
+    printf("speedup:         %8.1fx\n", t_scanf / t_parse);
+    for (i = 0; i < corpus_count; i++)
+        free(corpus[i]);
+    return failures == 0 ? 0 : 1;
+}
+
+#else
+
+int main(void)
+{
+    printf("parse_proc_stat() is only available on Linux\n");
+    return 0;
+}
+
+#endif
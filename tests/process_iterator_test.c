@@ -25,26 +25,77 @@
 
 #undef NDEBUG
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include <limits.h>
 
+#include "../src/affinity.h"
+#include "../src/cgroup.h"
+#include "../src/controller.h"
+#include "../src/estimator.h"
+#include "../src/event_loop.h"
 #include "../src/process_iterator.h"
+#include "../src/process_events.h"
 #include "../src/process_group.h"
+#include "../src/process_matcher.h"
+#include "../src/process_table.h"
 #include "../src/util.h"
 
 #ifndef __GNUC__
 #define __attribute__(attr)
 #endif
 
+char *command = NULL;
+
 static void ignore_signal(int sig __attribute__((unused)))
 {
 }
 
+#ifdef WRAP_ALLOCATOR
+/* count the allocations, the allocator being wrapped by the linker (see the Makefile) */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t nmemb, size_t size);
+void *__wrap_realloc(void *ptr, size_t size);
+
+static int count_allocations = 0;
+static unsigned long allocations = 0;
+
+void *__wrap_malloc(size_t size)
+{
+    if (count_allocations)
+        allocations++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+    if (count_allocations)
+        allocations++;
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    if (count_allocations)
+        allocations++;
+    return __real_realloc(ptr, size);
+}
+#endif
+
 static void test_single_process(void)
 {
     struct process_iterator it;
@@ -56,6 +107,10 @@ static void test_single_process(void)
     /* don't iterate children */
     filter.pid = getpid();
     filter.include_children = 0;
+    filter.known = NULL;
+    filter.fields = PROCESS_FIELDS_STATUS | PROCESS_FIELD_COMMAND;
+    filter.name = NULL;
+    filter.cgroup_fd = -1;
     count = 0;
     init_process_iterator(&it, &filter);
     while (get_next_process(&it, process) == 0)
@@ -70,6 +125,10 @@ static void test_single_process(void)
     /* iterate children */
     filter.pid = getpid();
     filter.include_children = 0;
+    filter.known = NULL;
+    filter.fields = PROCESS_FIELDS_STATUS | PROCESS_FIELD_COMMAND;
+    filter.name = NULL;
+    filter.cgroup_fd = -1;
     count = 0;
     init_process_iterator(&it, &filter);
     while (get_next_process(&it, process) == 0)
@@ -101,6 +160,10 @@ static void test_multiple_process(void)
     assert(process != NULL);
     filter.pid = getpid();
     filter.include_children = 1;
+    filter.known = NULL;
+    filter.fields = PROCESS_FIELDS_STATUS | PROCESS_FIELD_COMMAND;
+    filter.name = NULL;
+    filter.cgroup_fd = -1;
     init_process_iterator(&it, &filter);
     while (get_next_process(&it, process) == 0)
     {
@@ -117,6 +180,96 @@ static void test_multiple_process(void)
     free(process);
     close_process_iterator(&it);
     kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+}
+
+static void test_process_tree(void)
+{
+    struct process_iterator it;
+    struct process *process;
+    struct process_filter filter;
+    int count = 0, fds[2];
+    pid_t child, grandchild;
+    assert(pipe(fds) == 0);
+    child = fork();
+    if (child == 0)
+    {
+        /* child forks a grandchild and reports its pid */
+        grandchild = fork();
+        if (grandchild == 0)
+        {
+            while (1)
+                sleep(5);
+        }
+        assert(write(fds[1], &grandchild, sizeof(grandchild)) == sizeof(grandchild));
+        while (1)
+            sleep(5);
+    }
+    assert(read(fds[0], &grandchild, sizeof(grandchild)) == sizeof(grandchild));
+    close(fds[0]);
+    close(fds[1]);
+    process = (struct process *)malloc(sizeof(struct process));
+    assert(process != NULL);
+    filter.pid = getpid();
+    filter.include_children = 1;
+    filter.known = NULL;
+    filter.fields = PROCESS_FIELDS_STATUS | PROCESS_FIELD_COMMAND;
+    filter.name = NULL;
+    filter.cgroup_fd = -1;
+    init_process_iterator(&it, &filter);
+    while (get_next_process(&it, process) == 0)
+    {
+        if (process->pid == child)
+            assert(process->ppid == getpid());
+        else if (process->pid == grandchild)
+            assert(process->ppid == child);
+        else
+            assert(process->pid == getpid());
+        count++;
+    }
+    assert(count == 3);
+    assert(iterator_is_child_of(&it, grandchild, getpid()) == 1);
+    assert(iterator_is_child_of(&it, grandchild, child) == 1);
+    assert(iterator_is_child_of(&it, child, grandchild) == 0);
+    free(process);
+    close_process_iterator(&it);
+    kill(grandchild, SIGKILL);
+    kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+}
+
+static void test_process_handles(void)
+{
+    struct process_iterator it;
+    struct process *process;
+    struct process_filter filter;
+    int status;
+    pid_t child = fork();
+    if (child == 0)
+    {
+        while (1)
+            sleep(5);
+    }
+    process = (struct process *)malloc(sizeof(struct process));
+    assert(process != NULL);
+    filter.pid = child;
+    filter.include_children = 0;
+    filter.known = NULL;
+    filter.fields = PROCESS_FIELDS_STATUS | PROCESS_FIELD_COMMAND;
+    filter.name = NULL;
+    filter.cgroup_fd = -1;
+    init_process_iterator(&it, &filter);
+    assert(get_next_process(&it, process) == 0);
+    close_process_iterator(&it);
+    open_process_handles(process);
+    assert(signal_process(process, SIGSTOP) == 0);
+    assert(waitpid(child, &status, WUNTRACED) == child && WIFSTOPPED(status));
+    assert(signal_process(process, SIGKILL) == 0);
+    assert(waitpid(child, &status, 0) == child && WIFSIGNALED(status));
+    /* the process has been waited for, it can no longer be signaled */
+    assert(signal_process(process, SIGCONT) != 0);
+    close_process_handles(process);
+    free(process);
 }
 
 static void test_all_processes(void)
@@ -127,6 +280,10 @@ static void test_all_processes(void)
     int count = 0;
     filter.pid = 0;
     filter.include_children = 0;
+    filter.known = NULL;
+    filter.fields = PROCESS_FIELDS_STATUS | PROCESS_FIELD_COMMAND;
+    filter.name = NULL;
+    filter.cgroup_fd = -1;
     process = (struct process *)malloc(sizeof(struct process));
     assert(process != NULL);
     init_process_iterator(&it, &filter);
@@ -186,9 +343,9 @@ static void test_process_group_single(int include_children)
             const struct process *p = (const struct process *)(node->data);
             assert(p->pid == child);
             assert(p->ppid == getpid());
-            /* p->cpu_usage should be -1 or [0, 1] */
+            /* p->cpu_usage should be -1 or [0, 1], give or take a clock tick */
             assert((p->cpu_usage >= (-1.00001) && p->cpu_usage <= (-0.99999)) ||
-                   (p->cpu_usage >= 0 && p->cpu_usage <= 1.0));
+                   (p->cpu_usage >= 0 && p->cpu_usage <= 1.2));
             count++;
         }
         assert(count == 1);
@@ -198,9 +355,385 @@ static void test_process_group_single(int include_children)
     }
     assert(close_process_group(&pgroup) == 0);
     kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
 }
 
-char *command = NULL;
+static void *spin(void *arg)
+{
+    volatile int unused_value = 0;
+    (void)arg;
+    while (1)
+        (void)unused_value;
+    return NULL;
+}
+
+static void test_process_group_multithreaded(void)
+{
+    struct process_group pgroup;
+    struct timespec interval = {0, 100000000}, start, end;
+    const struct process *p;
+    double cputime;
+    int i;
+    pid_t child = fork();
+    if (child == 0)
+    {
+        /* 8 busy threads use up to 8 CPUs */
+        pthread_t thread;
+        for (i = 0; i < 7; i++)
+            pthread_create(&thread, NULL, spin, NULL);
+        spin(NULL);
+    }
+    assert(init_process_group(&pgroup, child, 0) == 0);
+    for (i = 0; i < 30; i++)
+    {
+        sleep_timespec(&interval);
+        update_process_group(&pgroup);
+    }
+    p = (const struct process *)pgroup.proclist->first->data;
+    cputime = p->cputime;
+    get_time(&start);
+    for (i = 0; i < 20; i++)
+    {
+        sleep_timespec(&interval);
+        update_process_group(&pgroup);
+    }
+    get_time(&end);
+    /* the estimation is the CPU time used per second, not capped at one CPU */
+    cputime = (p->cputime - cputime) / timediff_in_ms(&end, &start);
+    assert(cputime > 0.5 * MIN(8, get_ncpu()));
+    assert(p->cpu_usage > cputime * 0.8 && p->cpu_usage < cputime * 1.2);
+    assert(close_process_group(&pgroup) == 0);
+    kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+}
+
+static void test_process_group_reaped_children(int include_children)
+{
+    struct process_group pgroup;
+    struct list_node *node;
+    struct timespec interval = {0, 100000000};
+    double usage = 0;
+    int i;
+    pid_t parent = fork();
+    if (parent == 0)
+    {
+        /* keep one short-lived busy child running at a time */
+        while (1)
+        {
+            pid_t worker = fork();
+            if (worker == 0)
+            {
+                struct timespec start, now;
+                get_time(&start);
+                do
+                {
+                    get_time(&now);
+                } while (timediff_in_ms(&now, &start) < 30);
+                _exit(EXIT_SUCCESS);
+            }
+            waitpid(worker, NULL, 0);
+        }
+    }
+    assert(init_process_group(&pgroup, parent, include_children) == 0);
+    for (i = 0; i < 40; i++)
+    {
+        sleep_timespec(&interval);
+        update_process_group(&pgroup);
+    }
+    for (node = pgroup.proclist->first; node != NULL; node = node->next)
+    {
+        const struct process *p = (const struct process *)(node->data);
+        if (p->cpu_usage >= 0)
+            usage += p->cpu_usage;
+    }
+    /* the workers keep one CPU busy, whether they are tracked or not */
+    assert(usage > 0.5 && usage < 1.5);
+    assert(close_process_group(&pgroup) == 0);
+    kill(parent, SIGKILL);
+    waitpid(parent, NULL, 0);
+}
+
+/* peak resident set size of the test, in kilobytes */
+static long get_max_rss(void)
+{
+    struct rusage usage;
+    assert(getrusage(RUSAGE_SELF, &usage) == 0);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+static void test_process_group_churn(void)
+{
+    struct process_group pgroup;
+    struct timespec interval = {0, 5000000};
+    long rss;
+    int i;
+    pid_t parent = fork();
+    if (parent == 0)
+    {
+        /* fork short-lived children forever, in a process group killed at the end */
+        struct timespec lifetime = {0, 3000000};
+        setpgid(0, 0);
+        while (1)
+        {
+            pid_t child = fork();
+            if (child == 0)
+            {
+                sleep_timespec(&lifetime);
+                _exit(EXIT_SUCCESS);
+            }
+            waitpid(child, NULL, 0);
+        }
+    }
+    assert(init_process_group(&pgroup, parent, 1) == 0);
+    for (i = 0; i < 200; i++)
+    {
+        sleep_timespec(&interval);
+        update_process_group(&pgroup);
+    }
+    rss = get_max_rss();
+    for (i = 0; i < 1000; i++)
+    {
+        sleep_timespec(&interval);
+        update_process_group(&pgroup);
+    }
+    /* the processes which have left the group must have been freed */
+    assert(pgroup.proctable->count == pgroup.proclist->count);
+    /* the memory of the group must not grow with the churn */
+    assert(get_max_rss() - rss < 256);
+    assert(close_process_group(&pgroup) == 0);
+    /* the last child must not outlive the test, it would run the test executable */
+    kill(-parent, SIGKILL);
+    kill(parent, SIGKILL);
+    waitpid(parent, NULL, 0);
+    for (i = 0; i < 100 && kill(-parent, 0) == 0; i++)
+        sleep_timespec(&interval);
+}
+
+static void test_process_group_allocations(void)
+{
+#ifdef WRAP_ALLOCATOR
+    struct process_group pgroup;
+    struct process_matcher matcher;
+    struct timespec interval = {0, 2000000};
+    int i, matching;
+    pid_t child = fork();
+    if (child == 0)
+    {
+        while (1)
+            sleep(5);
+    }
+    /* a PID and its children, then the instances of the executable (-a) */
+    assert(process_matcher_init(&matcher, MATCH_EXE, command) == 0);
+    for (matching = 0; matching < 2; matching++)
+    {
+        if (matching)
+            assert(init_process_group_matching(&pgroup, &matcher, 0) == 0);
+        else
+            assert(init_process_group(&pgroup, getpid(), 1) == 0);
+        /* let the buffers of the group grow */
+        for (i = 0; i < 10; i++)
+            update_process_group(&pgroup);
+        allocations = 0;
+        count_allocations = 1;
+        for (i = 0; i < 1000; i++)
+        {
+            sleep_timespec(&interval);
+            update_process_group(&pgroup);
+        }
+        count_allocations = 0;
+        /* the steady state of a stable group must not allocate memory */
+        assert(allocations == 0);
+        /* the current process is left out of the instances */
+        assert(pgroup.hot.count == (matching ? 1 : 2));
+        assert(close_process_group(&pgroup) == 0);
+    }
+    process_matcher_destroy(&matcher);
+    kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+#endif
+}
+
+static void test_process_group_changes(void)
+{
+    struct process_group pgroup;
+    int i;
+    pid_t child;
+    assert(init_process_group(&pgroup, getpid(), 1) == 0);
+    update_process_group(&pgroup);
+    assert(pgroup.joined.count == 0);
+    assert(pgroup.left.count == 0);
+    child = fork();
+    if (child == 0)
+    {
+        while (1)
+            sleep(5);
+    }
+    update_process_group(&pgroup);
+    assert(pgroup.joined.count == 1);
+    assert(pgroup.joined.pid[0] == child);
+    assert(pgroup.left.count == 0);
+    /* the member vectors are sorted by PID and match the list */
+    assert(pgroup.hot.count == pgroup.proclist->count);
+    for (i = 1; i < pgroup.hot.count; i++)
+        assert(pgroup.hot.pid[i - 1] < pgroup.hot.pid[i]);
+    for (i = 0; i < pgroup.hot.count; i++)
+        assert(((const struct process *)pgroup.hot.node[i]->data)->pid == pgroup.hot.pid[i]);
+    kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+    update_process_group(&pgroup);
+    assert(pgroup.joined.count == 0);
+    assert(pgroup.left.count == 1);
+    assert(pgroup.left.pid[0] == child);
+    assert(locate_node(pgroup.proclist, &child) == NULL);
+    assert(pgroup.hot.count == pgroup.proclist->count);
+    update_process_group(&pgroup);
+    assert(pgroup.joined.count == 0);
+    assert(pgroup.left.count == 0);
+    assert(close_process_group(&pgroup) == 0);
+}
+
+static void test_refresh_process_group(void)
+{
+    struct process_group pgroup;
+    struct list joined;
+    pid_t child;
+    assert(init_process_group(&pgroup, getpid(), 1) == 0);
+    init_list(&joined, sizeof(pid_t));
+    assert(refresh_process_group(&pgroup, &joined) == 0);
+    child = fork();
+    if (child == 0)
+    {
+        while (1)
+            sleep(5);
+    }
+    assert(refresh_process_group(&pgroup, &joined) == 1);
+    assert(joined.count == 1);
+    assert(((const struct process *)first_elem(&joined))->pid == child);
+    assert(locate_node(pgroup.proclist, &child) != NULL);
+    clear_list(&joined);
+    assert(refresh_process_group(&pgroup, &joined) == 0);
+    assert(close_process_group(&pgroup) == 0);
+    kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+}
+
+static void test_process_group_events(void)
+{
+    struct process_group pgroup;
+    struct timespec interval = {0, 50000000};
+    int events_fd, i, count;
+    pid_t child;
+    if ((events_fd = open_process_events()) < 0)
+    {
+        /* process events are not available to this user */
+        return;
+    }
+    assert(init_process_group(&pgroup, getpid(), 1) == 0);
+    process_group_use_events(&pgroup, events_fd);
+    count = pgroup.proclist->count;
+    assert(count >= 1);
+    child = fork();
+    if (child == 0)
+    {
+        while (1)
+            sleep(5);
+    }
+    for (i = 0; i < 40 && pgroup.proclist->count == count; i++)
+    {
+        sleep_timespec(&interval);
+        assert(process_group_apply_events(&pgroup) >= 0);
+    }
+    assert(pgroup.proclist->count == count + 1);
+    assert(locate_node(pgroup.proclist, &child) != NULL);
+    kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+    for (i = 0; i < 40 && pgroup.proclist->count > count; i++)
+    {
+        sleep_timespec(&interval);
+        assert(process_group_apply_events(&pgroup) >= 0);
+    }
+    assert(pgroup.proclist->count == count);
+    assert(locate_node(pgroup.proclist, &child) == NULL);
+    update_process_group(&pgroup);
+    assert(pgroup.proclist->count == count);
+    assert(close_process_group(&pgroup) == 0);
+    close_process_events(events_fd);
+}
+
+static void test_process_group_early_events(void)
+{
+    struct process_group pgroup;
+    int events_fd, count, joined, left;
+    pid_t child;
+    if ((events_fd = open_process_events()) < 0)
+    {
+        /* process events are not available to this user */
+        return;
+    }
+    /* the fork is queued before the group is scanned */
+    child = fork();
+    if (child == 0)
+    {
+        while (1)
+            sleep(5);
+    }
+    assert(init_process_group(&pgroup, getpid(), 1) == 0);
+    process_group_use_events(&pgroup, events_fd);
+    count = pgroup.proclist->count;
+    joined = pgroup.joined.count;
+    left = pgroup.left.count;
+    assert(locate_node(pgroup.proclist, &child) != NULL);
+    assert(process_group_apply_events(&pgroup) >= 0);
+    assert(pgroup.proclist->count == count);
+    assert(pgroup.joined.count == joined);
+    assert(pgroup.left.count == left);
+    kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+    assert(close_process_group(&pgroup) == 0);
+    close_process_events(events_fd);
+}
+
+static void test_process_table(void)
+{
+    struct process_table pt;
+    struct process *processes;
+    pid_t pid;
+    int i, n = 5000;
+    processes = (struct process *)calloc((size_t)n, sizeof(struct process));
+    assert(processes != NULL);
+    process_table_init(&pt, 16);
+    for (i = 0; i < n; i++)
+    {
+        processes[i].pid = (pid_t)(i * 7 + 1);
+        process_table_add(&pt, &processes[i]);
+    }
+    assert(pt.count == n);
+    for (i = 0; i < n; i++)
+    {
+        assert(process_table_find_pid(&pt, (pid_t)(i * 7 + 1)) == &processes[i]);
+        assert(process_table_find_pid(&pt, (pid_t)(i * 7 + 2)) == NULL);
+    }
+    /* delete every other process, the others must remain reachable */
+    for (i = 0; i < n; i += 2)
+        assert(process_table_del(&pt, &processes[i]) == 0);
+    assert(process_table_del_pid(&pt, 1) == 1);
+    assert(pt.count == n / 2);
+    for (i = 0; i < n; i++)
+    {
+        pid = (pid_t)(i * 7 + 1);
+        assert(process_table_find_pid(&pt, pid) == (i % 2 == 0 ? NULL : &processes[i]));
+    }
+    for (i = 1; i < n; i += 2)
+        assert(process_table_del_pid(&pt, processes[i].pid) == 0);
+    assert(pt.count == 0);
+    /* the table is empty, destroying it frees none of the processes */
+    process_table_destroy(&pt);
+    free(processes);
+}
 
 static void test_process_name(void)
 {
@@ -212,18 +745,108 @@ static void test_process_name(void)
     assert(process != NULL);
     filter.pid = getpid();
     filter.include_children = 0;
+    filter.known = NULL;
+    filter.fields = PROCESS_FIELDS_STATUS | PROCESS_FIELD_COMMAND;
+    filter.name = NULL;
+    filter.cgroup_fd = -1;
     init_process_iterator(&it, &filter);
     assert(get_next_process(&it, process) == 0);
     assert(process->pid == getpid());
     assert(process->ppid == getppid());
     proc_name1 = basename(command);
     proc_name2 = basename(process->command);
-    assert(strncmp(proc_name1, proc_name2, sizeof(process->command)) == 0);
+    assert(strncmp(proc_name1, proc_name2, PATH_MAX) == 0);
     assert(get_next_process(&it, process) != 0);
     free(process);
     close_process_iterator(&it);
 }
 
+static void test_process_fields(void)
+{
+    struct process_iterator it;
+    struct process process;
+    struct process_filter filter;
+    int found = 0;
+    filter.pid = getpid();
+    filter.include_children = 0;
+    filter.known = NULL;
+    filter.name = NULL;
+    filter.cgroup_fd = -1;
+    /* the command is only read when asked for */
+    filter.fields = PROCESS_FIELDS_STATUS;
+    init_process_iterator(&it, &filter);
+    assert(get_next_process(&it, &process) == 0);
+    assert(process.pid == getpid());
+    assert(process.command == NULL);
+    close_process_iterator(&it);
+    filter.fields = PROCESS_FIELD_EXE;
+    init_process_iterator(&it, &filter);
+    assert(get_next_process(&it, &process) == 0);
+    assert(strcmp(basename(process.command), basename(command)) == 0);
+    close_process_iterator(&it);
+    /* the name of the executable skips the processes with another comm */
+    filter.pid = 0;
+    filter.fields = PROCESS_FIELD_PID | PROCESS_FIELD_COMMAND;
+    filter.name = basename(command);
+    init_process_iterator(&it, &filter);
+    while (get_next_process(&it, &process) == 0)
+        found |= process.pid == getpid();
+    close_process_iterator(&it);
+    assert(found);
+#ifdef __linux__
+    filter.name = "no such executable";
+    init_process_iterator(&it, &filter);
+    assert(get_next_process(&it, &process) != 0);
+    close_process_iterator(&it);
+#endif
+}
+
+static void test_process_group_fd_limit(void)
+{
+    pid_t limited = fork();
+    int status;
+    if (limited == 0)
+    {
+        struct process_group pgroup;
+        struct event_loop loop;
+        struct rlimit rl;
+        pid_t children[100];
+        int i;
+        /* the handles of the members would exceed the limit of open files */
+        assert(getrlimit(RLIMIT_NOFILE, &rl) == 0);
+        rl.rlim_cur = 128;
+        assert(setrlimit(RLIMIT_NOFILE, &rl) == 0);
+        for (i = 0; i < 100; i++)
+        {
+            if ((children[i] = fork()) == 0)
+            {
+                while (1)
+                    sleep(5);
+            }
+        }
+        assert(init_process_group(&pgroup, getpid(), 1) == 0);
+        assert(pgroup.proclist->count == 101);
+        for (i = 0; i < 10; i++)
+        {
+            update_process_group(&pgroup);
+            assert(pgroup.left.count == 0);
+        }
+        /* the members without handles are still sampled, and descriptors are left */
+        assert(pgroup.proclist->count == 101);
+        assert(open_event_loop(&loop) == 0);
+        close_event_loop(&loop);
+        assert(close_process_group(&pgroup) == 0);
+        for (i = 0; i < 100; i++)
+        {
+            kill(children[i], SIGKILL);
+            waitpid(children[i], NULL, 0);
+        }
+        exit(EXIT_SUCCESS);
+    }
+    assert(waitpid(limited, &status, 0) == limited);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+}
+
 static void test_process_group_wrong_pid(void)
 {
     struct process_group pgroup;
@@ -287,6 +910,431 @@ static void test_find_process_by_name(void)
     free(wrong_name);
 }
 
+static pid_t fork_idle_child(void)
+{
+    pid_t child = fork();
+    if (child == 0)
+    {
+        while (1)
+            pause();
+    }
+    assert(child > 0);
+    return child;
+}
+
+static void test_process_group_matching(void)
+{
+    struct process_group pgroup;
+    struct process_matcher matcher;
+    pid_t children[4];
+    int i;
+    /* the children run the same executable as the current process, which is left out */
+    assert(process_matcher_init(&matcher, MATCH_EXE, command) == 0);
+    for (i = 0; i < 3; i++)
+        children[i] = fork_idle_child();
+    assert(init_process_group_matching(&pgroup, &matcher, 0) == 0);
+    assert(pgroup.proclist->count == 3);
+    assert(process_table_find_pid(pgroup.proctable, getpid()) == NULL);
+    /* an exited instance leaves and a new one joins */
+    kill(children[0], SIGKILL);
+    waitpid(children[0], NULL, 0);
+    children[3] = fork_idle_child();
+    update_process_group(&pgroup);
+    assert(pgroup.proclist->count == 3);
+    assert(process_table_find_pid(pgroup.proctable, children[0]) == NULL);
+    assert(process_table_find_pid(pgroup.proctable, children[3]) != NULL);
+    assert(pgroup.joined.count == 1 && pgroup.joined.pid[0] == children[3]);
+    assert(pgroup.left.count == 1 && pgroup.left.pid[0] == children[0]);
+    for (i = 1; i < 4; i++)
+    {
+        kill(children[i], SIGKILL);
+        waitpid(children[i], NULL, 0);
+    }
+    update_process_group(&pgroup);
+    assert(pgroup.proclist->count == 0);
+    assert(close_process_group(&pgroup) == 0);
+    process_matcher_destroy(&matcher);
+}
+
+#ifdef __linux__
+/* move a process into a cgroup, return 0 on success */
+static int move_to_cgroup(const char *dir, pid_t pid)
+{
+    char path[PATH_MAX];
+    FILE *f;
+    int ret;
+    sprintf(path, "%s/cgroup.procs", dir);
+    if ((f = fopen(path, "w")) == NULL)
+        return -1;
+    ret = fprintf(f, "%ld\n", (long)pid) > 0;
+    return fclose(f) == 0 && ret ? 0 : -1;
+}
+
+/* find where the cgroup2 hierarchy is mounted, return 0 on success */
+static int find_cgroup2_mount(char *mount)
+{
+    char line[PATH_MAX + 64], type[16];
+    FILE *mounts;
+    int found = 0;
+    if ((mounts = fopen("/proc/self/mounts", "r")) == NULL)
+        return -1;
+    while (!found && fgets(line, sizeof(line), mounts) != NULL)
+        found = sscanf(line, "%*s %4095s %15s", mount, type) == 2 && strcmp(type, "cgroup2") == 0;
+    fclose(mounts);
+    return found ? 0 : -1;
+}
+
+static void test_process_group_cgroup(void)
+{
+    struct process_group pgroup;
+    char mount[PATH_MAX], top[PATH_MAX + 64], sub[PATH_MAX + 128];
+    pid_t children[2];
+    int fd, i;
+    /* the test needs a writable cgroup2 file system */
+    if (find_cgroup2_mount(mount) != 0)
+        return;
+    sprintf(top, "%s/cpulimit-test-%ld", mount, (long)getpid());
+    sprintf(sub, "%s/sub", top);
+    if (mkdir(top, 0755) != 0)
+        return;
+    assert(mkdir(sub, 0755) == 0);
+    assert(open_cgroup("/proc") < 0);
+    assert((fd = open_cgroup(top)) >= 0);
+    assert(cgroup_is_populated(fd) == 0);
+    assert(wait_cgroup_populated(fd, 0) == 0);
+
+    /* a process of the cgroup and one of its descendant cgroup */
+    for (i = 0; i < 2; i++)
+        children[i] = fork_idle_child();
+    if (move_to_cgroup(top, children[0]) == 0 && move_to_cgroup(sub, children[1]) == 0)
+    {
+        assert(wait_cgroup_populated(fd, 1000) == 1);
+        assert(init_process_group_cgroup(&pgroup, fd) == 0);
+        assert(pgroup.proclist->count == 2);
+        assert(process_table_find_pid(pgroup.proctable, children[0]) != NULL);
+        assert(process_table_find_pid(pgroup.proctable, children[1]) != NULL);
+        assert(process_table_find_pid(pgroup.proctable, getpid()) == NULL);
+        kill(children[0], SIGKILL);
+        waitpid(children[0], NULL, 0);
+        update_process_group(&pgroup);
+        assert(pgroup.proclist->count == 1);
+        assert(pgroup.left.count == 1 && pgroup.left.pid[0] == children[0]);
+        assert(close_process_group(&pgroup) == 0);
+    }
+    for (i = 0; i < 2; i++)
+    {
+        kill(children[i], SIGKILL);
+        waitpid(children[i], NULL, 0);
+    }
+    close(fd);
+    rmdir(sub);
+    rmdir(top);
+}
+
+static void test_cgroup_freezer(void)
+{
+    struct cgroup_freezer freezer;
+    struct cgroup_cpu_stat cpu_stat;
+    char mount[PATH_MAX], leaf[PATH_MAX + 64], events[256];
+    struct stat st;
+    pid_t child, gone;
+    int fd, i;
+    ssize_t n;
+    if (find_cgroup2_mount(mount) != 0 || create_cgroup_freezer(&freezer) != 0)
+        return;
+    sprintf(leaf, "%s/%s", mount, freezer.leaf);
+    child = fork_idle_child();
+    assert(cgroup_freezer_add(&freezer, child) == 0);
+    /* adding a process twice or a process which has exited is harmless */
+    assert(cgroup_freezer_add(&freezer, child) == 0);
+    assert(freezer.moved_count == 1);
+    if ((gone = fork()) == 0)
+        _exit(EXIT_SUCCESS);
+    waitpid(gone, NULL, 0);
+    errno = EINVAL;
+    assert(cgroup_freezer_add(&freezer, gone) == 0);
+    assert(freezer.moved_count == 1);
+    assert(cgroup_has_process(freezer.cgroup_fd, child) == 1);
+    assert(cgroup_has_process(freezer.cgroup_fd, getpid()) == 0);
+    assert(cgroup_freezer_set(&freezer, 1) == 0);
+    /* the freezing completes asynchronously */
+    for (i = 0; i < 100; i++)
+    {
+        assert((fd = openat(freezer.cgroup_fd, "cgroup.events", O_RDONLY)) >= 0);
+        n = read(fd, events, sizeof(events) - 1);
+        close(fd);
+        assert(n > 0);
+        events[n] = '\0';
+        if (strstr(events, "frozen 1") != NULL)
+            break;
+        usleep(10000);
+    }
+    assert(i < 100);
+    assert(cgroup_freezer_set(&freezer, 0) == 0);
+    /* cpu.stat is always there, cpu.max only if the cpu controller is available */
+    assert(read_cgroup_cpu_stat(freezer.cgroup_fd, &cpu_stat) == 0);
+    assert(cpu_stat.usage_usec >= 0 && cpu_stat.nr_throttled <= cpu_stat.nr_periods);
+    if (enable_cgroup_cpu(freezer.cgroup_fd) == 0)
+    {
+        assert(write_cgroup_cpu_max(freezer.cgroup_fd, "50000 100000") == 0);
+        assert(read_cgroup_cpu_max(freezer.cgroup_fd, events, sizeof(events)) == 0);
+        assert(strcmp(events, "50000 100000") == 0);
+    }
+    /* the child leaves the leaf, which is removed */
+    close_cgroup_freezer(&freezer);
+    assert(stat(leaf, &st) != 0);
+    kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+}
+
+static void test_process_affinity(void)
+{
+    struct process_affinity affinity;
+    cpu_set_t own, mask;
+    pid_t child;
+    int ncpu;
+    assert(sched_getaffinity(0, sizeof(own), &own) == 0);
+    ncpu = CPU_COUNT(&own);
+    /* confining the processes to all the CPUs would be useless */
+    assert(init_process_affinity(&affinity, ncpu) != 0);
+    if (ncpu < 2)
+        return;
+    assert(init_process_affinity(&affinity, 1) == 0);
+    child = fork_idle_child();
+    assert(confine_process(&affinity, child) == 0);
+    assert(sched_getaffinity(child, sizeof(mask), &mask) == 0 && CPU_COUNT(&mask) == 1);
+    release_process(&affinity, child);
+    assert(sched_getaffinity(child, sizeof(mask), &mask) == 0 && CPU_EQUAL(&mask, &own));
+    /* the processes still confined are released when the confinement ends */
+    assert(confine_process(&affinity, child) == 0);
+    close_process_affinity(&affinity);
+    assert(sched_getaffinity(child, sizeof(mask), &mask) == 0 && CPU_EQUAL(&mask, &own));
+    kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+}
+#endif
+
+static void test_process_matcher(void)
+{
+    struct process_matcher matcher;
+    char pattern[PATH_MAX + 2];
+    int64_t first = -1;
+    int i, spread = 0;
+    /* the executable file of the current process, found by path */
+    assert(process_matcher_init(&matcher, MATCH_EXE, command) == 0);
+    assert(find_process_by_matcher(&matcher) == getpid());
+    /* the second scan uses the cached identities */
+    assert(find_process_by_matcher(&matcher) == getpid());
+    assert(process_matches(getpid(), &matcher));
+    assert(!process_matches(getppid(), &matcher));
+    /* the results computed together do not expire together */
+    for (i = 0; i < matcher.size; i++)
+    {
+        const struct match_entry *e = &matcher.entries[i];
+        if (e->pid == 0)
+            continue;
+        assert(e->expires > matcher.now - 1000 && e->expires <= matcher.now + 10000);
+        if (first < 0)
+            first = e->expires;
+        spread |= e->expires != first;
+    }
+    assert(spread);
+    process_matcher_forget_all(&matcher);
+    assert(find_process_by_matcher(&matcher) == getpid());
+    process_matcher_destroy(&matcher);
+    assert(process_matcher_init(&matcher, MATCH_EXE, "/nonexistent/file") != 0);
+
+    sprintf(pattern, "%.*s*", (int)strlen(basename(command)) - 2, basename(command));
+    assert(process_matcher_init(&matcher, MATCH_GLOB, pattern) == 0);
+    assert(find_process_by_matcher(&matcher) == getpid());
+    process_matcher_destroy(&matcher);
+    assert(process_matcher_init(&matcher, MATCH_GLOB, "*/no such file") == 0);
+    assert(find_process_by_matcher(&matcher) == 0);
+    process_matcher_destroy(&matcher);
+
+    sprintf(pattern, "^%s$", basename(command));
+    assert(process_matcher_init(&matcher, MATCH_REGEX, pattern) == 0);
+    assert(find_process_by_matcher(&matcher) == getpid());
+    process_matcher_destroy(&matcher);
+    assert(process_matcher_init(&matcher, MATCH_REGEX, "^no such file$") == 0);
+    assert(find_process_by_matcher(&matcher) == 0);
+    process_matcher_destroy(&matcher);
+    assert(process_matcher_init(&matcher, MATCH_REGEX, "(") != 0);
+}
+
+static void test_pi_controller(void)
+{
+    struct pi_controller c;
+    /* first order lag like the estimation of the CPU usage, with the error
+       scaled by the demand as cpulimit does */
+    const double alpha = 0.08, dt = 0.1, limit = 1, demand = 4;
+    double usage = 0, rate, peak = 0;
+    int i;
+    pi_controller_init(&c, 1, alpha / dt, 0, dt / alpha / 4, 0.01, 0.99);
+    pi_controller_reset(&c, limit / demand * 2);
+    rate = c.integral;
+    for (i = 0; i < 600; i++)
+    {
+        usage += alpha * (demand * rate - usage);
+        rate = pi_controller_update(&c, (limit - usage) / demand, dt);
+        if (i >= 100)
+            peak = MAX(peak, usage);
+    }
+    assert(peak < limit * 1.05);
+    assert(usage > limit * 0.99 && usage < limit * 1.01);
+    assert(rate > limit / demand * 0.99 && rate < limit / demand * 1.01);
+
+    /* the integral does not wind up while the output is saturated */
+    pi_controller_init(&c, 1, 1, 0, 0.1, 0.01, 0.99);
+    for (i = 0; i < 100; i++)
+        assert(pi_controller_update(&c, 1, dt) <= 0.99);
+    assert(c.integral <= 0.99);
+    assert(pi_controller_update(&c, -0.1, dt) < 0.99);
+
+    /* the filtered derivative term follows a change of the error */
+    pi_controller_init(&c, 0, 0, 1, 0.1, -10, 10);
+    pi_controller_reset(&c, 0);
+    pi_controller_update(&c, 0, dt);
+    assert(pi_controller_update(&c, 1, dt) > 0);
+}
+
+/* feed an estimator with the CPU time of a process using usage before
+   time step and usage after it, measured in clock ticks of 10 ms. Return
+   the time (in ms) the estimation takes to get within 5% of the new usage */
+static double estimator_step(int type, double dt, double usage, double step, double *estimate)
+{
+    struct usage_estimator e;
+    struct usage_estimate s;
+    double t, total = 0, measured = 0, reached = -1;
+    assert(usage_estimator_init(&e, type, ESTIMATOR_DEFAULT_TAU) == 0);
+    usage_estimate_init(&s);
+    *estimate = -1;
+    for (t = dt; t <= 20000; t += dt)
+    {
+        double ticks;
+        total += (t <= 10000 ? usage : step) * dt;
+        ticks = (double)(long)(total / 10) * 10;
+        *estimate = usage_estimator_update(&e, &s, *estimate, ticks - measured, dt);
+        measured = ticks;
+        if (t <= 10000 || *estimate < step * 0.95 || *estimate > step * 1.05)
+            reached = -1;
+        else if (reached < 0)
+            reached = t - 10000;
+    }
+    return reached;
+}
+
+static void test_usage_estimator(void)
+{
+    struct usage_estimator e;
+    struct usage_estimate s;
+    double estimate, fast, slow;
+    int type;
+    assert(usage_estimator_init(&e, 3, 1000) != 0);
+    assert(usage_estimator_init(&e, ESTIMATOR_EWMA, 0) != 0);
+
+    /* the first estimation waits for a few clock ticks */
+    assert(usage_estimator_init(&e, ESTIMATOR_EWMA, 1000) == 0);
+    usage_estimate_init(&s);
+    assert(usage_estimator_update(&e, &s, -1, 10, 10) < 0);
+    fast = usage_estimator_update(&e, &s, -1, 0, ESTIMATOR_MIN_SPAN);
+    assert(fast > 0 && fast < 0.1);
+
+    /* the response of the moving average does not depend on the interval */
+    usage_estimate_init(&s);
+    fast = usage_estimator_update(&e, &s, -1, 0, ESTIMATOR_MIN_SPAN);
+    for (estimate = 0; estimate < 100; estimate++)
+        fast = usage_estimator_update(&e, &s, fast, 10, 10);
+    usage_estimate_init(&s);
+    slow = usage_estimator_update(&e, &s, -1, 0, 500);
+    slow = usage_estimator_update(&e, &s, slow, 500, 500);
+    slow = usage_estimator_update(&e, &s, slow, 500, 500);
+    assert(fast > 0.63 && fast < 0.64);
+    assert(slow > 0.63 && slow < 0.64);
+
+    /* the window is an exact average over its span */
+    assert(usage_estimator_init(&e, ESTIMATOR_WINDOW, 1000) == 0);
+    usage_estimate_init(&s);
+    estimate = usage_estimator_update(&e, &s, -1, 100, 100);
+    for (type = 0; type < 30; type++)
+        estimate = usage_estimator_update(&e, &s, estimate, type % 2 ? 50 : 0, 50);
+    assert(estimate > 0.499 && estimate < 0.501);
+
+    /* every estimator follows a change of the load, with any interval */
+    for (type = ESTIMATOR_EWMA; type <= ESTIMATOR_KALMAN; type++)
+    {
+        assert(estimator_step(type, 100, 0.2, 0.8, &estimate) >= 0);
+        assert(estimate > 0.76 && estimate < 0.84);
+        assert(estimator_step(type, 400, 0.8, 0.2, &estimate) >= 0);
+        assert(estimate > 0.19 && estimate < 0.21);
+    }
+    /* the window and the Kalman filter settle sooner than the moving average */
+    slow = estimator_step(ESTIMATOR_EWMA, 100, 0.2, 0.8, &estimate);
+    assert(estimator_step(ESTIMATOR_WINDOW, 100, 0.2, 0.8, &estimate) < slow);
+    assert(estimator_step(ESTIMATOR_KALMAN, 100, 0.2, 0.8, &estimate) < slow);
+}
+
+/* keep the CPU busy for the given time (in ms) */
+static void busy_wait(double ms)
+{
+    struct timespec start, now;
+    assert(get_time(&start) == 0);
+    do
+        assert(get_time(&now) == 0);
+    while (timediff_in_ms(&now, &start) < ms);
+}
+
+static void test_event_loop(void)
+{
+    const struct timespec period = {0, 5000000L};
+    struct event_loop loop;
+    struct timespec start, end;
+    int i, fds[2], epoll = open_event_loop(&loop) == 0;
+
+    /* the work done between the waits does not delay the deadlines */
+    event_loop_restart(&loop);
+    assert(get_time(&start) == 0);
+    for (i = 0; i < 20; i++)
+    {
+        busy_wait(1);
+        assert(event_loop_wait(&loop, &period) == EVENT_LOOP_TIMEOUT);
+        assert(loop.lateness >= 0);
+    }
+    assert(get_time(&end) == 0);
+    assert(timediff_in_ms(&end, &start) >= 99 && timediff_in_ms(&end, &start) < 110);
+
+    /* an overrun deadline is moved to now instead of being made up for */
+    busy_wait(20);
+    assert(event_loop_wait(&loop, &period) == EVENT_LOOP_TIMEOUT);
+    assert(loop.lateness > 14e6);
+    assert(get_time(&start) == 0);
+    assert(event_loop_wait(&loop, &period) == EVENT_LOOP_TIMEOUT);
+    assert(get_time(&end) == 0);
+    assert(timediff_in_ms(&end, &start) < 6);
+
+    if (!epoll)
+    {
+        close_event_loop(&loop);
+        return;
+    }
+
+    /* a watched descriptor ends the wait, which can then go on */
+    assert(pipe(fds) == 0);
+    assert(event_loop_watch(&loop, fds[0]) == 0);
+    assert(write(fds[1], "x", 1) == 1);
+    assert(event_loop_wait(&loop, &period) == EVENT_LOOP_READY);
+    assert(loop.ready_fd == fds[0]);
+    assert(read(fds[0], &i, 1) == 1);
+    assert(event_loop_wait(&loop, NULL) == EVENT_LOOP_TIMEOUT);
+
+    /* the termination signals are received by the loop */
+    raise(SIGTERM);
+    assert(event_loop_wait(&loop, &period) == EVENT_LOOP_QUIT);
+    close_event_loop(&loop);
+    close(fds[0]);
+    close(fds[1]);
+}
+
 static void test_getppid_of(void)
 {
     struct process_iterator it;
@@ -294,6 +1342,10 @@ static void test_getppid_of(void)
     struct process_filter filter;
     filter.pid = 0;
     filter.include_children = 0;
+    filter.known = NULL;
+    filter.fields = PROCESS_FIELDS_STATUS | PROCESS_FIELD_COMMAND;
+    filter.name = NULL;
+    filter.cgroup_fd = -1;
     process = (struct process *)malloc(sizeof(struct process));
     assert(process != NULL);
     init_process_iterator(&it, &filter);
@@ -306,6 +1358,34 @@ static void test_getppid_of(void)
     assert(getppid_of(getpid()) == getppid());
 }
 
+#ifdef __linux__
+static void test_parse_proc_stat(void)
+{
+    /* the command name contains spaces and parentheses */
+    static const char line[] =
+        "4242 (a) (b c)) S 1 4242 4241 0 -1 4194560 10 20 0 0 150 25 7 3 "
+        "20 0 4 0 123456 1024 10 18446744073709551615 0 0 0 0 0 0 0 0 0 0 "
+        "0 0 17 0 0 0 0 0 0 0 0 0 0 0 0 0 0\n";
+    struct proc_stat st;
+    assert(parse_proc_stat(line, strlen(line), &st) == 0);
+    assert(st.state == 'S');
+    assert(strcmp(st.comm, "a) (b c)") == 0);
+    assert(st.ppid == 1);
+    assert(st.pgrp == 4242);
+    assert(st.session == 4241);
+    assert(st.utime == 150);
+    assert(st.stime == 25);
+    assert(st.cutime == 7);
+    assert(st.cstime == 3);
+    assert(st.num_threads == 4);
+    assert(st.starttime == 123456);
+    /* truncated or malformed content */
+    assert(parse_proc_stat(line, 60, &st) != 0);
+    assert(parse_proc_stat("4242 (a) S x", 12, &st) != 0);
+    assert(parse_proc_stat("4242 a S 1", 10, &st) != 0);
+}
+#endif
+
 int main(int argc __attribute__((unused)), char *argv[])
 {
     /* ignore SIGINT and SIGTERM during tests*/
@@ -320,14 +1400,43 @@ int main(int argc __attribute__((unused)), char *argv[])
     increase_priority();
     test_single_process();
     test_multiple_process();
+    test_process_tree();
+    test_process_handles();
     test_all_processes();
     test_process_group_all();
     test_process_group_single(0);
     test_process_group_single(1);
     test_process_group_wrong_pid();
+#ifdef __linux__
+    test_process_group_fd_limit();
+#endif
+    test_process_group_multithreaded();
+    test_process_group_reaped_children(0);
+    test_process_group_reaped_children(1);
+    test_process_group_churn();
+    test_process_group_matching();
+#ifdef __linux__
+    test_process_group_cgroup();
+    test_cgroup_freezer();
+    test_process_affinity();
+#endif
+    test_process_group_allocations();
+    test_process_group_changes();
+    test_refresh_process_group();
+    test_process_group_events();
+    test_process_group_early_events();
+    test_process_table();
     test_process_name();
+    test_process_fields();
     test_find_process_by_pid();
     test_find_process_by_name();
+    test_process_matcher();
+    test_pi_controller();
+    test_usage_estimator();
+    test_event_loop();
     test_getppid_of();
+#ifdef __linux__
+    test_parse_proc_stat();
+#endif
     return 0;
 }
@@ -0,0 +1,252 @@
+/**
+ *
+ * cpulimit - a CPU limiter for Linux
+ *
+ * Copyright (C) 2005-2012, by:  Angelo Marletta <angelo dot marletta at gmail dot com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Microbenchmark of the open addressing process table against the
+ * chained hash table it replaced (2048 buckets of linked lists), with
+ * 1k, 10k and 100k tracked processes.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/list.h"
+#include "../src/process_table.h"
+#include "../src/util.h"
+
+/* Number of lookups performed by each lookup benchmark */
+#define TOTAL_LOOKUPS 2000000
+
+/* The chained hash table used before the open addressing one */
+struct legacy_table
+{
+    struct list **table;
+    int hashsize;
+};
+
+static void legacy_init(struct legacy_table *pt, int hashsize)
+{
+    pt->hashsize = hashsize;
+    pt->table = (struct list **)calloc((size_t)pt->hashsize, sizeof(struct list *));
+    if (pt->table == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed for the process table\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static struct process *legacy_find(const struct legacy_table *pt, const struct process *p)
+{
+    int idx = p->pid % pt->hashsize;
+    if (pt->table[idx] == NULL)
+        return NULL;
+    return (struct process *)locate_elem(pt->table[idx], p);
+}
+
+static struct process *legacy_find_pid(const struct legacy_table *pt, pid_t pid)
+{
+    struct process *p, *res;
+    p = (struct process *)malloc(sizeof(struct process));
+    if (p == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed for the process\n");
+        exit(EXIT_FAILURE);
+    }
+    p->pid = pid;
+    res = legacy_find(pt, p);
+    free(p);
+    return res;
+}
+
+static void legacy_add(struct legacy_table *pt, struct process *p)
+{
+    int idx = p->pid % pt->hashsize;
+    if (pt->table[idx] == NULL)
+    {
+        pt->table[idx] = (struct list *)malloc(sizeof(struct list));
+        if (pt->table[idx] == NULL)
+        {
+            fprintf(stderr, "Memory allocation failed for the process list\n");
+            exit(EXIT_FAILURE);
+        }
+        init_list(pt->table[idx], sizeof(pid_t));
+    }
+    add_elem(pt->table[idx], p);
+}
+
+static int legacy_del_pid(struct legacy_table *pt, pid_t pid)
+{
+    struct process *p;
+    struct list_node *node;
+    int idx = pid % pt->hashsize;
+    p = (struct process *)malloc(sizeof(struct process));
+    if (p == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed for the process\n");
+        exit(EXIT_FAILURE);
+    }
+    p->pid = pid;
+    node = pt->table[idx] == NULL ? NULL : locate_node(pt->table[idx], p);
+    free(p);
+    if (node == NULL)
+        return 1;
+    delete_node(pt->table[idx], node);
+    return 0;
+}
+
+static void legacy_destroy(struct legacy_table *pt)
+{
+    int i;
+    for (i = 0; i < pt->hashsize; i++)
+    {
+        if (pt->table[i] != NULL)
+        {
+            /* the processes belong to the benchmark */
+            clear_list(pt->table[i]);
+            free(pt->table[i]);
+        }
+    }
+    free(pt->table);
+}
+
+static struct process *processes;
+static pid_t *pids;
+static int count;
+
+static struct process *process_at(int i)
+{
+    return &processes[i];
+}
+
+/* distinct PIDs spread over the default pid_max of 64-bit Linux */
+static void make_processes(int n)
+{
+    int i;
+    count = n;
+    processes = (struct process *)calloc((size_t)n, sizeof(struct process));
+    pids = (pid_t *)malloc((size_t)n * sizeof(pid_t));
+    if (processes == NULL || pids == NULL)
+    {
+        fprintf(stderr, "Memory allocation failed for the processes\n");
+        exit(EXIT_FAILURE);
+    }
+    srand(42);
+    for (i = 0; i < n; i++)
+    {
+        pids[i] = (pid_t)(i * 41 + rand() % 41 + 2);
+        process_at(i)->pid = pids[i];
+    }
+    /* look the processes up in random order */
+    for (i = n - 1; i > 0; i--)
+    {
+        int j = rand() % (i + 1);
+        pid_t tmp = pids[i];
+        pids[i] = pids[j];
+        pids[j] = tmp;
+    }
+}
+
+static double elapsed_ns(const struct timespec *start, int ops)
+{
+    struct timespec end;
+    get_time(&end);
+    return timediff_in_ms(&end, start) * 1e6 / ops;
+}
+
+static void bench(int n)
+{
+    struct process_table pt;
+    struct legacy_table lt;
+    struct timespec start;
+    double t[2][4];
+    int i, r, found = 0, rounds;
+
+    make_processes(n);
+    rounds = TOTAL_LOOKUPS / n + 1;
+
+    get_time(&start);
+    legacy_init(&lt, 2048);
+    for (i = 0; i < n; i++)
+        legacy_add(&lt, process_at(i));
+    t[0][0] = elapsed_ns(&start, n);
+    get_time(&start);
+    for (r = 0; r < rounds; r++)
+        for (i = 0; i < n; i++)
+            found += legacy_find_pid(&lt, pids[i]) != NULL;
+    t[0][1] = elapsed_ns(&start, rounds * n);
+    get_time(&start);
+    for (r = 0; r < rounds; r++)
+        for (i = 0; i < n; i++)
+            found += legacy_find_pid(&lt, pids[i] + 1) != NULL;
+    t[0][2] = elapsed_ns(&start, rounds * n);
+    get_time(&start);
+    for (i = 0; i < n; i++)
+        found += legacy_del_pid(&lt, pids[i]) == 0;
+    t[0][3] = elapsed_ns(&start, n);
+    legacy_destroy(&lt);
+
+    get_time(&start);
+    process_table_init(&pt, 2048);
+    for (i = 0; i < n; i++)
+        process_table_add(&pt, process_at(i));
+    t[1][0] = elapsed_ns(&start, n);
+    get_time(&start);
+    for (r = 0; r < rounds; r++)
+        for (i = 0; i < n; i++)
+            found -= process_table_find_pid(&pt, pids[i]) != NULL;
+    t[1][1] = elapsed_ns(&start, rounds * n);
+    get_time(&start);
+    for (r = 0; r < rounds; r++)
+        for (i = 0; i < n; i++)
+            found -= process_table_find_pid(&pt, pids[i] + 1) != NULL;
+    t[1][2] = elapsed_ns(&start, rounds * n);
+    get_time(&start);
+    for (i = 0; i < n; i++)
+        found -= process_table_del_pid(&pt, pids[i]) == 0;
+    t[1][3] = elapsed_ns(&start, n);
+    if (found != 0 || pt.count != 0)
+    {
+        fprintf(stderr, "The tables disagree with %d processes\n", n);
+        exit(EXIT_FAILURE);
+    }
+    /* the processes belong to the benchmark */
+    free(pt.keys);
+    free(pt.values);
+
+    printf("%7d %-8s%10.1f%10.1f%10.1f%10.1f\n", n, "chained", t[0][0], t[0][1], t[0][2], t[0][3]);
+    printf("%7d %-8s%10.1f%10.1f%10.1f%10.1f\n", n, "flat", t[1][0], t[1][1], t[1][2], t[1][3]);
+    free(processes);
+    free(pids);
+}
+
+int main(void)
+{
+    printf("%7s %-8s%10s%10s%10s%10s   (ns/op)\n", "members", "table", "add", "hit", "miss", "delete");
+    bench(1000);
+    bench(10000);
+    bench(100000);
+    return 0;
+}